@@ -2,8 +2,10 @@
 
 #include "al2o3_platform/platform.h"
 #include "al2o3_handle/handle.h"
+#include "al2o3_memory/memory.h"
 #include "render_meshmod/mesh.h"
 #include "render_basics/api.h"
+#include "al2o3_cmath/vector.h"
 #include "al2o3_cmath/matrix.h"
 
 enum MeshModRender_RenderStyle {
@@ -15,22 +17,167 @@ enum MeshModRender_RenderStyle {
 	MMR_MAX
 };
 
+#define MMR_MAX_VIEWS 6
+
 typedef struct MeshModRender_Manager MeshModRender_Manager;
 typedef struct { Handle_Handle32 handle; } MeshModRender_MeshHandle;
 typedef struct Render_GpuView Render_GpuView;
 
+typedef struct MeshModRender_ManagerDesc {
+	// mesh calls may come from any thread, they are applied by MeshModRender_ManagerBeginFrame
+	bool concurrent;
+	// frames before a released gpu object is destroyed, max 4
+	uint32_t framesInFlight;
+	uint32_t workerThreadCount;
+	// an existing directory to cache built vertices in, NULL for none. 0 max bytes is 256MB
+	char const* cacheDirectory;
+	uint64_t cacheMaxBytes;
+	// NULL for the global allocator, meshmod and CADT allocations don't go through it
+	Memory_Allocator* allocator;
+	uint32_t scratchBytes;
+	// 0 for 256x144
+	uint32_t occlusionWidth;
+	uint32_t occlusionHeight;
+	// vertex shaders can write SV_RenderTargetArrayIndex, needed for more than one view
+	bool multiView;
+} MeshModRender_ManagerDesc;
+
+typedef struct MeshModRender_AllocatorStats {
+	uint64_t liveBytes;
+	uint64_t peakBytes;
+	uint64_t liveAllocations;
+	uint64_t totalAllocations;
+} MeshModRender_AllocatorStats;
+
+// meshmod meshes and snapshots aren't counted
+typedef struct MeshModRender_MemoryStats {
+	// includes the blocks behind scratch and pool
+	MeshModRender_AllocatorStats heap;
+	MeshModRender_AllocatorStats scratch;
+	MeshModRender_AllocatorStats pool;
+} MeshModRender_MemoryStats;
+
 AL2O3_EXTERN_C MeshModRender_Manager* MeshModRender_ManagerCreate(Render_RendererHandle renderer, Render_ROPLayout const* targetLayout);
+AL2O3_EXTERN_C MeshModRender_Manager* MeshModRender_ManagerCreateWithDesc(Render_RendererHandle renderer,
+		Render_ROPLayout const* targetLayout,
+		MeshModRender_ManagerDesc const* desc);
 AL2O3_EXTERN_C void MeshModRender_ManagerDestroy( MeshModRender_Manager* manager);
+// once per frame on the render thread before rendering
+AL2O3_EXTERN_C void MeshModRender_ManagerBeginFrame(MeshModRender_Manager* manager);
+AL2O3_EXTERN_C void MeshModRender_ManagerGetMemoryStats(MeshModRender_Manager* manager, MeshModRender_MemoryStats* stats);
 AL2O3_EXTERN_C void MeshModRender_ManagerSetView(MeshModRender_Manager* manager, Render_GpuView* view);
+// following draws are instanced across the views, one target array slice each.
+// Up to 4 calls per frame, draws already encoded keep their views
+AL2O3_EXTERN_C void MeshModRender_ManagerSetViews(MeshModRender_Manager* manager, uint32_t count, Render_GpuView const* views);
 
 AL2O3_EXTERN_C MeshModRender_MeshHandle MeshModRender_MeshCreate(MeshModRender_Manager* manager, MeshMod_MeshHandle mhandle);
 AL2O3_EXTERN_C void MeshModRender_MeshDestroy(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle);
 
 AL2O3_EXTERN_C void MeshModRender_MeshSetStyle(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, MeshModRender_RenderStyle style);
+// in concurrent mode this behaves as MeshModRender_MeshUpdateAsync
 AL2O3_EXTERN_C void MeshModRender_MeshUpdate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle);
+
+// rebuilds from a snapshot in the background, the mesh may be edited as soon as
+// this returns. MeshModRender_ManagerBeginFrame swaps the new build in
+AL2O3_EXTERN_C void MeshModRender_MeshUpdateAsync(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle);
+// render thread only
+AL2O3_EXTERN_C bool MeshModRender_MeshIsUpToDate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle);
+// render thread only, applies queued commands first if the mesh has any
+AL2O3_EXTERN_C void MeshModRender_MeshWaitForUpdate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle);
+
+// filled by the next update
+AL2O3_EXTERN_C void MeshModRender_MeshSetRetainCpuCopy(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, bool retain);
+// NULL unless retained, the layout depends on the render style
+AL2O3_EXTERN_C void const* MeshModRender_MeshGetCpuVertices(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, uint32_t* vertexCount);
+// built by the next update
+AL2O3_EXTERN_C void MeshModRender_MeshSetPickable(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, bool pickable);
+
+typedef struct MeshModRender_PickHit {
+	MeshModRender_MeshHandle mesh;
+	// in the built vertex buffer
+	uint32_t triangle;
+	MeshMod_PolygonHandle polygon;
+	bool polygonValid;
+	// the triangle index if the mesh has no polygon id tag
+	uint32_t polygonId;
+	// in units of the ray directions length
+	float distance;
+} MeshModRender_PickHit;
+
+// render thread only, meshes not pickable or not yet built are skipped
+AL2O3_EXTERN_C bool MeshModRender_MeshPick(MeshModRender_Manager* manager,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* inverseLocalMatrices,
+		Math_Vec3F rayOrigin,
+		Math_Vec3F rayDirection,
+		float maxDistance,
+		MeshModRender_PickHit* hit);
+
+// render thread only, meshes that are neither pickable nor retain a cpu copy are
+// skipped. Lasts until the next call or view change
+AL2O3_EXTERN_C void MeshModRender_ManagerRenderOccluders(MeshModRender_Manager* manager,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices);
+
+AL2O3_EXTERN_C bool MeshModRender_MeshIsOccluded(MeshModRender_Manager* manager,
+		MeshModRender_MeshHandle mrhandle,
+		Math_Mat4F localMatrix);
+
+// bit i is set if the bounds touch view i
+AL2O3_EXTERN_C uint32_t MeshModRender_MeshGetViewMask(MeshModRender_Manager* manager,
+		MeshModRender_MeshHandle mrhandle,
+		Math_Mat4F localMatrix);
+
 AL2O3_EXTERN_C void MeshModRender_MeshRender(MeshModRender_Manager* manager,
 		Render_GraphicsEncoderHandle encoder,
 		MeshModRender_MeshHandle mrhandle,
 		Math_Mat4F localMatrix,
 	  Math_Mat4F inverseLocalMatrix);
 
+typedef enum MeshModRender_BatchFlags {
+	MMR_BF_NONE = 0,
+	// grouped by material, by depth in the first view
+	MMR_BF_SORT_FRONT_TO_BACK = 0x1,
+	// ignored without a depth target
+	MMR_BF_DEPTH_PREPASS = 0x2,
+	// single view only
+	MMR_BF_OCCLUSION_CULL = 0x4,
+	MMR_BF_FRUSTUM_CULL = 0x8,
+} MeshModRender_BatchFlags;
+
+// flags are MeshModRender_BatchFlags
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatch(MeshModRender_Manager* manager,
+		Render_GraphicsEncoderHandle encoder,
+		uint32_t flags,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices,
+		Math_Mat4F const* inverseLocalMatrices);
+
+// the inverses are computed by the manager
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatchLocal(MeshModRender_Manager* manager,
+		Render_GraphicsEncoderHandle encoder,
+		uint32_t flags,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices);
+
+// encoded on the workers, submit the encoders in order to keep the draw order
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatchParallel(MeshModRender_Manager* manager,
+		Render_GraphicsEncoderHandle const* encoders,
+		uint32_t encoderCount,
+		uint32_t flags,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices,
+		Math_Mat4F const* inverseLocalMatrices);
+
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatchLocalParallel(MeshModRender_Manager* manager,
+		Render_GraphicsEncoderHandle const* encoders,
+		uint32_t encoderCount,
+		uint32_t flags,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices);
@@ -0,0 +1,3 @@
+void FS_main()
+{
+}
\ No newline at end of file
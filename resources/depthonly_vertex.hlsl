@@ -0,0 +1,65 @@
+// must match MMR_MAX_VIEWS
+#define MAX_VIEWS 6
+
+// padded to a whole uniform block so the view set can start at any view
+struct ViewData
+{
+    float4x4 worldToViewMatrix;
+    float4x4 viewToNDCMatrix;
+    float4x4 worldToNDCMatrix;
+    uint viewIndex;
+    uint3 padding0;
+    float4 padding1[3];
+};
+
+cbuffer View : register(b0, space1)
+{
+    ViewData views[MAX_VIEWS];
+};
+
+cbuffer LocalToWorld : register(b1, space3)
+{
+    float4x4 localToWorldMatrix;
+    float4x4 localToWorldMatrixTranspose;
+};
+
+struct VSInput
+{
+    float4 Position : POSITION;
+    uint InstanceID : SV_InstanceID;
+};
+
+struct VSOutput {
+    float4 Position : SV_POSITION;
+};
+
+// needs the device to support writing the slice from a vertex shader
+struct VSMultiViewOutput {
+    float4 Position : SV_POSITION;
+    // each instance draws into its own slice of the target
+    uint ViewIndex  : SV_RenderTargetArrayIndex;
+};
+
+VSOutput VS_main(VSInput input)
+{
+    VSOutput result;
+    ViewData view = views[0];
+
+    // must match the main pass vertex shaders exactly so the depths are identical
+    result.Position = mul(localToWorldMatrix, input.Position);
+    result.Position = mul(view.worldToNDCMatrix, result.Position);
+    return result;
+}
+
+VSMultiViewOutput VS_multiview(VSInput input)
+{
+    VSMultiViewOutput result;
+    // the bound views start at the draws first view
+    ViewData view = views[input.InstanceID];
+
+    // must match the main pass vertex shaders exactly so the depths are identical
+    result.Position = mul(localToWorldMatrix, input.Position);
+    result.Position = mul(view.worldToNDCMatrix, result.Position);
+    result.ViewIndex = view.viewIndex;
+    return result;
+}
\ No newline at end of file
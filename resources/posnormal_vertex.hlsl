@@ -1,8 +1,20 @@
-cbuffer View : register(b0, space1)
+// must match MMR_MAX_VIEWS
+#define MAX_VIEWS 6
+
+// padded to a whole uniform block so the view set can start at any view
+struct ViewData
 {
     float4x4 worldToViewMatrix;
     float4x4 viewToNDCMatrix;
     float4x4 worldToNDCMatrix;
+    uint viewIndex;
+    uint3 padding0;
+    float4 padding1[3];
+};
+
+cbuffer View : register(b0, space1)
+{
+    ViewData views[MAX_VIEWS];
 };
 
 cbuffer LocalToWorld : register(b1, space3)
@@ -15,6 +27,7 @@ struct VSInput
 {
     float4 Position : POSITION;
     float3 Normal   : NORMAL;
+    uint InstanceID : SV_InstanceID;
 };
 
 struct VSOutput {
@@ -22,13 +35,36 @@ struct VSOutput {
     float4 Colour   : COLOR;
 };
 
+// needs the device to support writing the slice from a vertex shader
+struct VSMultiViewOutput {
+    float4 Position : SV_POSITION;
+    float4 Colour   : COLOR;
+    // each instance draws into its own slice of the target
+    uint ViewIndex  : SV_RenderTargetArrayIndex;
+};
+
 VSOutput VS_main(VSInput input)
 {
     VSOutput result;
+    ViewData view = views[0];
+
+    result.Position = mul(localToWorldMatrix, input.Position);
+    float4 worldNormal = mul(localToWorldMatrixTranspose, float4(input.Normal,0));
+    result.Position = mul(view.worldToNDCMatrix, result.Position);
+    result.Colour = (worldNormal*0.5f)+0.5f;
+    return result;
+}
+
+VSMultiViewOutput VS_multiview(VSInput input)
+{
+    VSMultiViewOutput result;
+    // the bound views start at the draws first view
+    ViewData view = views[input.InstanceID];
 
     result.Position = mul(localToWorldMatrix, input.Position);
     float4 worldNormal = mul(localToWorldMatrixTranspose, float4(input.Normal,0));
-    result.Position = mul(worldToNDCMatrix, result.Position);
+    result.Position = mul(view.worldToNDCMatrix, result.Position);
     result.Colour = (worldNormal*0.5f)+0.5f;
+    result.ViewIndex = view.viewIndex;
     return result;
 }
\ No newline at end of file
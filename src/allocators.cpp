@@ -0,0 +1,297 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_memory/memory.h"
+
+#include "allocators.hpp"
+
+// every heap and pool block starts with a header so frees know the size
+static size_t const HeaderSize = 16;
+static size_t const MinPoolBlockSize = 64;
+static uint32_t const NotPooled = ~0u;
+
+void MeshModRender_CountersAdd(MeshModRender_AllocatorCounters& counters, uint64_t bytes) {
+	uint64_t const live = Thread_AtomicFetchAdd64Relaxed(&counters.liveBytes, bytes) + bytes;
+	Thread_AtomicFetchAdd64Relaxed(&counters.liveAllocations, 1);
+	Thread_AtomicFetchAdd64Relaxed(&counters.totalAllocations, 1);
+	// a plain store could overwrite a higher peak from another thread
+	uint64_t peak = Thread_AtomicLoad64Relaxed(&counters.peakBytes);
+	while(live > peak) {
+		uint64_t const previous = Thread_AtomicCompareExchange64Relaxed(&counters.peakBytes, peak, live);
+		if(previous == peak) {
+			break;
+		}
+		peak = previous;
+	}
+}
+
+void MeshModRender_CountersRemove(MeshModRender_AllocatorCounters& counters, uint64_t bytes) {
+	Thread_AtomicFetchAdd64Relaxed(&counters.liveBytes, (uint64_t) -(int64_t) bytes);
+	Thread_AtomicFetchAdd64Relaxed(&counters.liveAllocations, (uint64_t) -1);
+}
+
+void MeshModRender_CountersGet(MeshModRender_AllocatorCounters& counters, MeshModRender_AllocatorStats& stats) {
+	stats.liveBytes = Thread_AtomicLoad64Relaxed(&counters.liveBytes);
+	stats.peakBytes = Thread_AtomicLoad64Relaxed(&counters.peakBytes);
+	stats.liveAllocations = Thread_AtomicLoad64Relaxed(&counters.liveAllocations);
+	stats.totalAllocations = Thread_AtomicLoad64Relaxed(&counters.totalAllocations);
+}
+
+void* MeshModRender_HeapAlloc(MeshModRender_Heap& heap, size_t size) {
+	auto base = (uint8_t*) heap.allocator->aalloc(size + HeaderSize, 16);
+	if(!base) {
+		return nullptr;
+	}
+	*(size_t*) base = size;
+	MeshModRender_CountersAdd(heap.counters, size);
+	return base + HeaderSize;
+}
+
+void* MeshModRender_HeapRealloc(MeshModRender_Heap& heap, void* memory, size_t size) {
+	if(!memory) {
+		return MeshModRender_HeapAlloc(heap, size);
+	}
+	size_t const oldSize = *(size_t*) ((uint8_t*) memory - HeaderSize);
+	if(size <= oldSize) {
+		return memory;
+	}
+	// aligned allocations can't go through realloc so copy
+	void* grown = MeshModRender_HeapAlloc(heap, size);
+	if(!grown) {
+		return nullptr;
+	}
+	memcpy(grown, memory, oldSize);
+	MeshModRender_HeapFree(heap, memory);
+	return grown;
+}
+
+void MeshModRender_HeapFree(MeshModRender_Heap& heap, void* memory) {
+	if(!memory) {
+		return;
+	}
+	auto base = (uint8_t*) memory - HeaderSize;
+	MeshModRender_CountersRemove(heap.counters, *(size_t*) base);
+	heap.allocator->free(base);
+}
+
+bool MeshModRender_ScratchCreate(MeshModRender_Scratch& scratch, MeshModRender_Heap* heap, size_t capacity) {
+	memset(&scratch, 0, sizeof(MeshModRender_Scratch));
+	scratch.heap = heap;
+	if(capacity) {
+		scratch.base = (uint8_t*) MeshModRender_HeapAlloc(*heap, capacity);
+		if(!scratch.base) {
+			return false;
+		}
+		scratch.capacity = capacity;
+	}
+	return true;
+}
+
+// frees spilled blocks newest first until the list is back to stop
+static void ScratchFreeOverflow(MeshModRender_Scratch& scratch, void* stop) {
+	while(scratch.overflow != stop) {
+		void* next = *(void**) scratch.overflow;
+		MeshModRender_HeapFree(*scratch.heap, scratch.overflow);
+		scratch.overflow = next;
+	}
+}
+
+// only called with the arena empty, grows to the high water mark so next time fits
+static void ScratchGrow(MeshModRender_Scratch& scratch) {
+	size_t const capacity = scratch.capacity + scratch.overflowPeakBytes;
+	MeshModRender_HeapFree(*scratch.heap, scratch.base);
+	scratch.base = (uint8_t*) MeshModRender_HeapAlloc(*scratch.heap, capacity);
+	scratch.capacity = scratch.base ? capacity : 0;
+	scratch.overflowPeakBytes = 0;
+}
+
+void MeshModRender_ScratchDestroy(MeshModRender_Scratch& scratch) {
+	if(!scratch.heap) {
+		return;
+	}
+	ScratchFreeOverflow(scratch, nullptr);
+	MeshModRender_HeapFree(*scratch.heap, scratch.base);
+	scratch.base = nullptr;
+	scratch.capacity = 0;
+}
+
+void* MeshModRender_ScratchAlloc(MeshModRender_Scratch& scratch, size_t size) {
+	size = (size + 15) & ~(size_t) 15;
+	MeshModRender_CountersAdd(scratch.counters, size);
+
+	if(scratch.offset + size <= scratch.capacity) {
+		void* memory = scratch.base + scratch.offset;
+		scratch.offset += size;
+		return memory;
+	}
+
+	// spill, the link pointer takes the first 16 bytes to keep the alignment
+	auto block = (uint8_t*) MeshModRender_HeapAlloc(*scratch.heap, size + 16);
+	if(!block) {
+		MeshModRender_CountersRemove(scratch.counters, size);
+		return nullptr;
+	}
+	*(void**) block = scratch.overflow;
+	scratch.overflow = block;
+	scratch.overflowBytes += size;
+	if(scratch.overflowBytes > scratch.overflowPeakBytes) {
+		scratch.overflowPeakBytes = scratch.overflowBytes;
+	}
+	return block + 16;
+}
+
+MeshModRender_ScratchMark MeshModRender_ScratchGetMark(MeshModRender_Scratch& scratch) {
+	return {
+			scratch.offset,
+			scratch.overflow,
+			scratch.overflowBytes,
+			Thread_AtomicLoad64Relaxed(&scratch.counters.liveBytes),
+			Thread_AtomicLoad64Relaxed(&scratch.counters.liveAllocations)
+	};
+}
+
+void MeshModRender_ScratchRewind(MeshModRender_Scratch& scratch, MeshModRender_ScratchMark const& mark) {
+	ScratchFreeOverflow(scratch, mark.overflow);
+	scratch.overflowBytes = mark.overflowBytes;
+	scratch.offset = mark.offset;
+	Thread_AtomicStore64Relaxed(&scratch.counters.liveBytes, mark.liveBytes);
+	Thread_AtomicStore64Relaxed(&scratch.counters.liveAllocations, mark.liveAllocations);
+
+	// back to empty, a good time to grow as nothing in the block is live
+	if(scratch.offset == 0 && !scratch.overflow && scratch.overflowPeakBytes) {
+		ScratchGrow(scratch);
+	}
+}
+
+void MeshModRender_ScratchReset(MeshModRender_Scratch& scratch) {
+	ScratchFreeOverflow(scratch, nullptr);
+	scratch.overflowBytes = 0;
+	if(scratch.overflowPeakBytes) {
+		ScratchGrow(scratch);
+	}
+	scratch.offset = 0;
+	Thread_AtomicStore64Relaxed(&scratch.counters.liveBytes, 0);
+	Thread_AtomicStore64Relaxed(&scratch.counters.liveAllocations, 0);
+}
+
+bool MeshModRender_PoolCreate(MeshModRender_Pool& pool, MeshModRender_Heap* heap) {
+	memset(&pool, 0, sizeof(MeshModRender_Pool));
+	pool.heap = heap;
+	return Thread_MutexCreate(&pool.lock);
+}
+
+void MeshModRender_PoolDestroy(MeshModRender_Pool& pool) {
+	if(!pool.heap) {
+		return;
+	}
+	for(uint32_t i = 0; i < MeshModRender_PoolClassCount; ++i) {
+		while(pool.freeBlocks[i]) {
+			void* next = *(void**) pool.freeBlocks[i];
+			MeshModRender_HeapFree(*pool.heap, pool.freeBlocks[i]);
+			pool.freeBlocks[i] = next;
+		}
+	}
+	Thread_MutexDestroy(&pool.lock);
+	pool.heap = nullptr;
+}
+
+void* MeshModRender_PoolAlloc(MeshModRender_Pool& pool, size_t size) {
+	uint32_t sizeClass = 0;
+	while(sizeClass < MeshModRender_PoolClassCount && (MinPoolBlockSize << sizeClass) < size + HeaderSize) {
+		sizeClass++;
+	}
+
+	uint8_t* block = nullptr;
+	size_t blockSize;
+	if(sizeClass == MeshModRender_PoolClassCount) {
+		sizeClass = NotPooled;
+		blockSize = size + HeaderSize;
+		block = (uint8_t*) MeshModRender_HeapAlloc(*pool.heap, blockSize);
+	} else {
+		blockSize = MinPoolBlockSize << sizeClass;
+		Thread_MutexAcquire(&pool.lock);
+		block = (uint8_t*) pool.freeBlocks[sizeClass];
+		if(block) {
+			pool.freeBlocks[sizeClass] = *(void**) block;
+			pool.freeCount[sizeClass]--;
+			if(pool.freeCount[sizeClass] < pool.freeLowWater[sizeClass]) {
+				pool.freeLowWater[sizeClass] = pool.freeCount[sizeClass];
+			}
+		}
+		Thread_MutexRelease(&pool.lock);
+		if(!block) {
+			block = (uint8_t*) MeshModRender_HeapAlloc(*pool.heap, blockSize);
+		}
+	}
+	if(!block) {
+		return nullptr;
+	}
+
+	*(uint32_t*) block = sizeClass;
+	*(uint64_t*) (block + 8) = blockSize - HeaderSize;
+	MeshModRender_CountersAdd(pool.counters, blockSize - HeaderSize);
+	return block + HeaderSize;
+}
+
+void MeshModRender_PoolFree(MeshModRender_Pool& pool, void* memory) {
+	if(!memory) {
+		return;
+	}
+	auto block = (uint8_t*) memory - HeaderSize;
+	uint32_t const sizeClass = *(uint32_t*) block;
+	MeshModRender_CountersRemove(pool.counters, *(uint64_t*) (block + 8));
+
+	if(sizeClass == NotPooled) {
+		MeshModRender_HeapFree(*pool.heap, block);
+		return;
+	}
+	Thread_MutexAcquire(&pool.lock);
+	*(void**) block = pool.freeBlocks[sizeClass];
+	pool.freeBlocks[sizeClass] = block;
+	pool.freeCount[sizeClass]++;
+	Thread_MutexRelease(&pool.lock);
+}
+
+void MeshModRender_PoolTrim(MeshModRender_Pool& pool) {
+	// unlinked under the lock, freed to the heap after it
+	void* trimmed = nullptr;
+	Thread_MutexAcquire(&pool.lock);
+	for(uint32_t i = 0; i < MeshModRender_PoolClassCount; ++i) {
+		for(uint32_t j = 0; j < pool.freeLowWater[i]; ++j) {
+			void* block = pool.freeBlocks[i];
+			pool.freeBlocks[i] = *(void**) block;
+			*(void**) block = trimmed;
+			trimmed = block;
+		}
+		pool.freeCount[i] -= pool.freeLowWater[i];
+		pool.freeLowWater[i] = pool.freeCount[i];
+	}
+	Thread_MutexRelease(&pool.lock);
+
+	while(trimmed) {
+		void* next = *(void**) trimmed;
+		MeshModRender_HeapFree(*pool.heap, trimmed);
+		trimmed = next;
+	}
+}
+
+bool MeshModRender_PoolArrayResize(MeshModRender_Pool& pool, MeshModRender_PoolArray& array, uint32_t elementSize, uint32_t count) {
+	size_t const bytes = (size_t) elementSize * count;
+	if(bytes > array.capacityBytes) {
+		MeshModRender_PoolFree(pool, array.data);
+		array.data = MeshModRender_PoolAlloc(pool, bytes);
+		if(!array.data) {
+			array.count = 0;
+			array.capacityBytes = 0;
+			return false;
+		}
+		// the whole size class is usable
+		array.capacityBytes = *(uint64_t*) ((uint8_t*) array.data - HeaderSize + 8);
+	}
+	array.elementSize = elementSize;
+	array.count = count;
+	return true;
+}
+
+void MeshModRender_PoolArrayFree(MeshModRender_Pool& pool, MeshModRender_PoolArray& array) {
+	MeshModRender_PoolFree(pool, array.data);
+	memset(&array, 0, sizeof(MeshModRender_PoolArray));
+}
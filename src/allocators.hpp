@@ -0,0 +1,101 @@
+#pragma once
+
+#include "al2o3_platform/platform.h"
+#include "al2o3_memory/memory.h"
+#include "al2o3_thread/thread.h"
+#include "al2o3_thread/atomic.h"
+#include "render_meshmodrender/render.h"
+
+// live/peak/total counters shared by the three allocator kinds, safe to update
+// from any thread
+struct MeshModRender_AllocatorCounters {
+	Thread_Atomic64_t liveBytes;
+	Thread_Atomic64_t peakBytes;
+	Thread_Atomic64_t liveAllocations;
+	Thread_Atomic64_t totalAllocations;
+};
+
+void MeshModRender_CountersAdd(MeshModRender_AllocatorCounters& counters, uint64_t bytes);
+void MeshModRender_CountersRemove(MeshModRender_AllocatorCounters& counters, uint64_t bytes);
+void MeshModRender_CountersGet(MeshModRender_AllocatorCounters& counters, MeshModRender_AllocatorStats& stats);
+
+// everything the manager allocates itself goes through here to the desc allocator
+// (or the global one), so it can be counted. 16 byte aligned, thread safe
+struct MeshModRender_Heap {
+	Memory_Allocator* allocator;
+	MeshModRender_AllocatorCounters counters;
+};
+
+void* MeshModRender_HeapAlloc(MeshModRender_Heap& heap, size_t size);
+void* MeshModRender_HeapRealloc(MeshModRender_Heap& heap, void* memory, size_t size);
+void MeshModRender_HeapFree(MeshModRender_Heap& heap, void* memory);
+
+// per frame linear arena for temporaries, render thread only. Allocations that
+// don't fit the block spill to the heap until they are rewound or reset, the
+// next time the arena is empty the block grows to cover the most that spilled
+// so steady state frames never touch the heap
+struct MeshModRender_Scratch {
+	MeshModRender_Heap* heap;
+	uint8_t* base;
+	size_t capacity;
+	size_t offset;
+	// spilled blocks, linked through their first pointer
+	void* overflow;
+	size_t overflowBytes;
+	// most bytes spilled at once since the block last grew
+	size_t overflowPeakBytes;
+	MeshModRender_AllocatorCounters counters;
+};
+
+struct MeshModRender_ScratchMark {
+	size_t offset;
+	void* overflow;
+	size_t overflowBytes;
+	uint64_t liveBytes;
+	uint64_t liveAllocations;
+};
+
+bool MeshModRender_ScratchCreate(MeshModRender_Scratch& scratch, MeshModRender_Heap* heap, size_t capacity);
+void MeshModRender_ScratchDestroy(MeshModRender_Scratch& scratch);
+void* MeshModRender_ScratchAlloc(MeshModRender_Scratch& scratch, size_t size);
+// rewinding frees everything allocated since the mark including spills, so
+// callers that never reset (no BeginFrame) don't accumulate heap blocks
+MeshModRender_ScratchMark MeshModRender_ScratchGetMark(MeshModRender_Scratch& scratch);
+void MeshModRender_ScratchRewind(MeshModRender_Scratch& scratch, MeshModRender_ScratchMark const& mark);
+void MeshModRender_ScratchReset(MeshModRender_Scratch& scratch);
+
+// power of 2 size classes from 64 bytes to 32MB, larger blocks go straight to the heap
+static uint32_t const MeshModRender_PoolClassCount = 20;
+
+// pooled blocks for data owned by renderables and builds. Freed blocks are kept
+// on a free list per size class for reuse, MeshModRender_PoolTrim returns the
+// ones that sat unused since the last trim to the heap. Thread safe
+struct MeshModRender_Pool {
+	MeshModRender_Heap* heap;
+	Thread_Mutex lock;
+	void* freeBlocks[MeshModRender_PoolClassCount];
+	uint32_t freeCount[MeshModRender_PoolClassCount];
+	// fewest blocks on each free list since the last trim, that many were never needed
+	uint32_t freeLowWater[MeshModRender_PoolClassCount];
+	MeshModRender_AllocatorCounters counters;
+};
+
+bool MeshModRender_PoolCreate(MeshModRender_Pool& pool, MeshModRender_Heap* heap);
+void MeshModRender_PoolDestroy(MeshModRender_Pool& pool);
+// 16 byte aligned
+void* MeshModRender_PoolAlloc(MeshModRender_Pool& pool, size_t size);
+void MeshModRender_PoolFree(MeshModRender_Pool& pool, void* memory);
+void MeshModRender_PoolTrim(MeshModRender_Pool& pool);
+
+// a pool backed array for the data renderables and builds own, every user
+// rewrites the whole array so the contents aren't kept when it grows
+struct MeshModRender_PoolArray {
+	void* data;
+	uint32_t count;
+	uint32_t elementSize;
+	size_t capacityBytes;
+};
+
+// false if out of memory, the array is left empty
+bool MeshModRender_PoolArrayResize(MeshModRender_Pool& pool, MeshModRender_PoolArray& array, uint32_t elementSize, uint32_t count);
+void MeshModRender_PoolArrayFree(MeshModRender_Pool& pool, MeshModRender_PoolArray& array);
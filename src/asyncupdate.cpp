@@ -0,0 +1,343 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_cadt/vector.h"
+#include "render_meshmodrender/render.h"
+#include "render_basics/buffer.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+#include "bvh.hpp"
+
+static void AsyncBuildJob(void* data, uint32_t) {
+	MeshModRender_AsyncBuildRun((MeshModRender_AsyncBuild*) data);
+}
+
+static void AsyncBuildFree(MeshModRender_Manager* manager, MeshModRender_AsyncBuild* build) {
+	MeshModRender_ReleaseBuffer(manager, build->vertexBuffer);
+	MeshModRender_PoolFree(manager->pool, build->chunk);
+	if(MeshMod_MeshHandleIsValid(build->snapshot)) {
+		MeshMod_MeshDestroy(build->snapshot);
+	}
+	MeshModRender_PoolArrayFree(manager->pool, build->vertices);
+	MeshModRender_PoolArrayFree(manager->pool, build->pickPositions);
+	MeshModRender_PoolArrayFree(manager->pool, build->pickPolygons);
+	MeshModRender_PoolArrayFree(manager->pool, build->pickPolygonIds);
+	MeshModRender_PoolArrayFree(manager->pool, build->triangles);
+	MeshModRender_BvhDestroy(build->bvh);
+	MeshModRender_PoolFree(manager->pool, build);
+}
+
+// arrays left holding more than the keep limit are freed, the next build that
+// needs one allocates it again
+static void AsyncBuildTrimArray(MeshModRender_Manager* manager, MeshModRender_PoolArray& array) {
+	if(array.capacityBytes > MeshModRender_AsyncBuildKeepBytes) {
+		MeshModRender_PoolArrayFree(manager->pool, array);
+	}
+}
+
+// drops a finished builds snapshot and bvh and keeps it with its smaller arrays
+// for the next build, as long as the free list isn't full
+static void AsyncBuildRecycle(MeshModRender_Manager* manager, MeshModRender_AsyncBuild* build) {
+	if(CADT_VectorSize(manager->asyncBuildsFree) >= MeshModRender_AsyncBuildsFreeMax) {
+		AsyncBuildFree(manager, build);
+		return;
+	}
+
+	// still set if the result was dropped
+	MeshModRender_ReleaseBuffer(manager, build->vertexBuffer);
+	build->vertexBuffer = {0};
+	MeshMod_MeshDestroy(build->snapshot);
+	build->snapshot = {0};
+	MeshModRender_BvhDestroy(build->bvh);
+	build->bvh = nullptr;
+	AsyncBuildTrimArray(manager, build->vertices);
+	AsyncBuildTrimArray(manager, build->pickPositions);
+	AsyncBuildTrimArray(manager, build->pickPolygons);
+	AsyncBuildTrimArray(manager, build->pickPolygonIds);
+	AsyncBuildTrimArray(manager, build->triangles);
+	CADT_VectorPushElement(manager->asyncBuildsFree, &build);
+}
+
+// builds never run on the calling thread, without a worker pool they get their own thread
+static MeshModRender_Workers* AsyncWorkers(MeshModRender_Manager* manager) {
+	if(MeshModRender_WorkersThreadCount(manager->workers)) {
+		return manager->workers;
+	}
+	if(!manager->asyncWorkers) {
+		manager->asyncWorkers = MeshModRender_WorkersCreate(1);
+	}
+	return manager->asyncWorkers;
+}
+
+// snapshot is taken over, if it isn't valid the renderables mesh is cloned
+static void AsyncBuildStart(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshMod_MeshRenderable* mesh, MeshMod_MeshHandle snapshot) {
+	MeshModRender_AsyncBuild* build;
+	CADT_VectorHandle freeBuilds = manager->asyncBuildsFree;
+	if(CADT_VectorSize(freeBuilds)) {
+		build = *(MeshModRender_AsyncBuild**) CADT_VectorAt(freeBuilds, CADT_VectorSize(freeBuilds) - 1);
+		CADT_VectorResize(freeBuilds, CADT_VectorSize(freeBuilds) - 1);
+	} else {
+		build = (MeshModRender_AsyncBuild*) MeshModRender_PoolAlloc(manager->pool, sizeof(MeshModRender_AsyncBuild));
+		if(!build) {
+			LOGERROR("MeshModRender out of memory starting async update");
+			if(MeshMod_MeshHandleIsValid(snapshot)) {
+				MeshMod_MeshDestroy(snapshot);
+			}
+			return;
+		}
+		memset(build, 0, sizeof(MeshModRender_AsyncBuild));
+	}
+	if(!build->chunk) {
+		build->chunk = MeshModRender_PoolAlloc(manager->pool, MeshModRender_StreamChunkSize);
+		if(!build->chunk) {
+			LOGERROR("MeshModRender out of memory starting async update");
+			AsyncBuildFree(manager, build);
+			if(MeshMod_MeshHandleIsValid(snapshot)) {
+				MeshMod_MeshDestroy(snapshot);
+			}
+			return;
+		}
+	}
+
+	// MeshMod only exposes attributes per handle, copying just the ones the build
+	// needs would be a per element gather, slower than the clones bulk copies
+	build->manager = manager;
+	build->handle = handle;
+	build->orphaned = false;
+	build->remaining = 1;
+	build->workers = AsyncWorkers(manager);
+	build->snapshot = MeshMod_MeshHandleIsValid(snapshot) ? snapshot : MeshMod_MeshClone(mesh->MMMesh);
+	build->style = manager->draws.renderStyle[mesh->drawIndex];
+	build->posHash = mesh->storedPosHash;
+	build->normalHash = mesh->storedNormalHash;
+	build->topologyHash = mesh->storedTopologyHash;
+	build->pickable = mesh->pickable;
+	build->retainCpuCopy = mesh->retainCpuCopy;
+	build->writeCache = !mesh->cacheWritten;
+	mesh->cacheWritten = true;
+	build->vertexCount = 0;
+	// a copy is cheap next to a rebuild and most async updates only move vertices
+	build->bvh = mesh->pickable ? MeshModRender_BvhClone(mesh->bvh) : nullptr;
+	build->refitTopologyHash = build->bvh ? mesh->pickTopologyHash : 0;
+
+	mesh->asyncBuild = build;
+	mesh->asyncPending = false;
+	CADT_VectorPushElement(manager->asyncBuilds, &build);
+	MeshModRender_WorkersSubmit(build->workers, &AsyncBuildJob, build, 0, &build->remaining);
+}
+
+static void AsyncBuildSwap(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh, MeshModRender_AsyncBuild* build) {
+	MeshModRender_DrawData& draws = manager->draws;
+	uint32_t const index = mesh->drawIndex;
+
+	// restyled while building so the result is in the wrong vertex format, the
+	// style change reset the hashes so the next update rebuilds. Recycling releases the buffer
+	if(draws.renderStyle[index] != build->style) {
+		return;
+	}
+
+	// the job streamed into a new buffer as the current one may still be used by
+	// frames in flight, so only the handles change here
+	MeshModRender_ReleaseBuffer(manager, draws.vertexBuffer[index]);
+	draws.vertexBuffer[index] = build->vertexBuffer;
+	build->vertexBuffer = {0};
+	draws.vertexCount[index] = build->vertexCount;
+	draws.localBoundsMin[index] = build->boundsMin;
+	draws.localBoundsMax[index] = build->boundsMax;
+	mesh->gpuVertexBufferCapacity = build->vertexCount;
+
+	// swap rather than copy, the build frees whatever it is left holding. A copy
+	// asked for after the build started is filled by the next update
+	if(mesh->retainCpuCopy && build->retainCpuCopy) {
+		MeshModRender_PoolArray const tmp = mesh->cpuVertexBuffer;
+		mesh->cpuVertexBuffer = build->vertices;
+		build->vertices = tmp;
+	}
+
+	if(mesh->pickable && build->pickable) {
+		MeshModRender_PoolArray tmp = mesh->pickPositions;
+		mesh->pickPositions = build->pickPositions;
+		build->pickPositions = tmp;
+		tmp = mesh->pickPolygons;
+		mesh->pickPolygons = build->pickPolygons;
+		build->pickPolygons = tmp;
+		tmp = mesh->pickPolygonIds;
+		mesh->pickPolygonIds = build->pickPolygonIds;
+		build->pickPolygonIds = tmp;
+		MeshModRender_Bvh* const bvh = mesh->bvh;
+		mesh->bvh = build->bvh;
+		build->bvh = bvh;
+		mesh->pickHasPolygonIds = build->pickHasPolygonIds;
+		mesh->pickTopologyHash = build->pickTopologyHash;
+	}
+}
+
+// the build must have finished and been removed from the in flight list
+static void AsyncBuildComplete(MeshModRender_Manager* manager, MeshModRender_AsyncBuild* build) {
+	if(!build->orphaned) {
+		auto mesh = MeshModRender_LookupMesh(manager, build->handle);
+		mesh->asyncBuild = nullptr;
+		AsyncBuildSwap(manager, mesh, build);
+
+		// every edit made while this was building collapses into one more build
+		if(mesh->asyncPending) {
+			MeshMod_MeshHandle const snapshot = mesh->pendingSnapshot;
+			mesh->pendingSnapshot = {0};
+			MeshModRender_StoreHashesIfChanged(mesh,
+					MeshMod_MeshHandleIsValid(snapshot) ? snapshot : mesh->MMMesh,
+					manager->draws.renderStyle[mesh->drawIndex]);
+			AsyncBuildStart(manager, build->handle, mesh, snapshot);
+		}
+	}
+	AsyncBuildRecycle(manager, build);
+}
+
+static void AsyncBuildRemove(MeshModRender_Manager* manager, size_t index) {
+	CADT_VectorHandle builds = manager->asyncBuilds;
+	size_t const last = CADT_VectorSize(builds) - 1;
+	if(index != last) {
+		memcpy(CADT_VectorAt(builds, index), CADT_VectorAt(builds, last), sizeof(MeshModRender_AsyncBuild*));
+	}
+	CADT_VectorResize(builds, last);
+}
+
+void MeshModRender_AsyncBuildsPoll(MeshModRender_Manager* manager) {
+	CADT_VectorHandle builds = manager->asyncBuilds;
+	size_t i = 0;
+	while(i < CADT_VectorSize(builds)) {
+		auto build = *(MeshModRender_AsyncBuild**) CADT_VectorAt(builds, i);
+		if(!MeshModRender_WorkersIsDone(build->workers, &build->remaining)) {
+			++i;
+			continue;
+		}
+		AsyncBuildRemove(manager, i);
+		AsyncBuildComplete(manager, build);
+	}
+}
+
+void MeshModRender_AsyncBuildFinish(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh) {
+	// loops as completing a build may start the coalesced follow up
+	while(mesh->asyncBuild) {
+		MeshModRender_AsyncBuild* build = mesh->asyncBuild;
+		MeshModRender_WorkersWait(build->workers, &build->remaining);
+
+		CADT_VectorHandle builds = manager->asyncBuilds;
+		for(size_t i = 0; i < CADT_VectorSize(builds); ++i) {
+			if(*(MeshModRender_AsyncBuild**) CADT_VectorAt(builds, i) == build) {
+				AsyncBuildRemove(manager, i);
+				break;
+			}
+		}
+		AsyncBuildComplete(manager, build);
+	}
+}
+
+void MeshModRender_AsyncBuildOrphan(MeshMod_MeshRenderable* mesh) {
+	if(mesh->asyncBuild) {
+		mesh->asyncBuild->orphaned = true;
+		mesh->asyncBuild = nullptr;
+	}
+	if(MeshMod_MeshHandleIsValid(mesh->pendingSnapshot)) {
+		MeshMod_MeshDestroy(mesh->pendingSnapshot);
+		mesh->pendingSnapshot = {0};
+	}
+	mesh->asyncPending = false;
+}
+
+void MeshModRender_AsyncBuildsDestroy(MeshModRender_Manager* manager) {
+	CADT_VectorHandle builds = manager->asyncBuilds;
+	if(!builds) {
+		return;
+	}
+	for(size_t i = 0; i < CADT_VectorSize(builds); ++i) {
+		auto build = *(MeshModRender_AsyncBuild**) CADT_VectorAt(builds, i);
+		MeshModRender_WorkersWait(build->workers, &build->remaining);
+		// drops any snapshot waiting to follow it
+		if(!build->orphaned) {
+			MeshModRender_AsyncBuildOrphan(MeshModRender_LookupMesh(manager, build->handle));
+		}
+		AsyncBuildFree(manager, build);
+	}
+	CADT_VectorDestroy(builds);
+	manager->asyncBuilds = nullptr;
+
+	CADT_VectorHandle freeBuilds = manager->asyncBuildsFree;
+	for(size_t i = 0; i < CADT_VectorSize(freeBuilds); ++i) {
+		AsyncBuildFree(manager, *(MeshModRender_AsyncBuild**) CADT_VectorAt(freeBuilds, i));
+	}
+	CADT_VectorDestroy(freeBuilds);
+	manager->asyncBuildsFree = nullptr;
+}
+
+void MeshModRender_ApplyMeshUpdateAsync(MeshModRender_Manager* manager, Handle_Handle32 handle) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	if(mesh->drawIndex == ~0u) {
+		return;
+	}
+
+	if(!MeshModRender_StoreHashesIfChanged(mesh, mesh->MMMesh, manager->draws.renderStyle[mesh->drawIndex])) {
+		return;
+	}
+
+	if(mesh->asyncBuild) {
+		mesh->asyncPending = true;
+		return;
+	}
+	AsyncBuildStart(manager, handle, mesh, {0});
+}
+
+void MeshModRender_ApplyMeshUpdateSnapshot(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshMod_MeshHandle snapshot) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	if(mesh->drawIndex == ~0u ||
+			!MeshModRender_StoreHashesIfChanged(mesh, snapshot, manager->draws.renderStyle[mesh->drawIndex])) {
+		MeshMod_MeshDestroy(snapshot);
+		return;
+	}
+
+	if(mesh->asyncBuild) {
+		// only the newest snapshot matters for the follow up build
+		if(MeshMod_MeshHandleIsValid(mesh->pendingSnapshot)) {
+			MeshMod_MeshDestroy(mesh->pendingSnapshot);
+		}
+		mesh->pendingSnapshot = snapshot;
+		mesh->asyncPending = true;
+		return;
+	}
+	AsyncBuildStart(manager, handle, mesh, snapshot);
+}
+
+// concurrent updates snapshot on the calling thread, the render thread never
+// reads a mesh another thread may be editing
+void MeshModRender_PushMeshUpdate(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshModRender_CommandType type) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	MeshModRender_Command command;
+	command.type = type;
+	command.handle = handle;
+	command.mesh = MeshMod_MeshClone(mesh->MMMesh);
+	MeshModRender_ComputeHashes(command.mesh);
+	Thread_AtomicFetchAdd32Relaxed(&mesh->queuedUpdates, 1);
+	MeshModRender_CommandPush(manager, command);
+}
+
+AL2O3_EXTERN_C void MeshModRender_MeshUpdateAsync(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshUpdateAsync(manager, mrhandle.handle);
+		return;
+	}
+
+	MeshModRender_PushMeshUpdate(manager, mrhandle.handle, MMR_CMD_UPDATE_ASYNC);
+}
+
+AL2O3_EXTERN_C bool MeshModRender_MeshIsUpToDate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
+	auto mesh = MeshModRender_LookupMesh(manager, mrhandle.handle);
+	return Thread_AtomicLoad32Relaxed(&mesh->queuedUpdates) == 0 &&
+			mesh->asyncBuild == nullptr &&
+			!mesh->asyncPending;
+}
+
+AL2O3_EXTERN_C void MeshModRender_MeshWaitForUpdate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
+	// updates still queued have to be applied before there is anything to wait on
+	if(Thread_AtomicLoad32Relaxed(&MeshModRender_LookupMesh(manager, mrhandle.handle)->queuedUpdates)) {
+		MeshModRender_CommandDrain(manager);
+	}
+	MeshModRender_AsyncBuildFinish(manager, MeshModRender_LookupMesh(manager, mrhandle.handle));
+}
@@ -0,0 +1,432 @@
+#include "al2o3_platform/platform.h"
+#include "render_meshmodrender/render.h"
+#include "render_basics/buffer.h"
+#include "render_basics/graphicsencoder.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+
+void MeshModRender_UploadLocalUniforms(MeshModRender_Manager* manager, uint32_t index, MeshModRender_LocalUniforms const& uniforms) {
+	Render_BufferUpdateDesc uniformUpdate = {
+			&uniforms,
+			0,
+			sizeof(MeshModRender_LocalUniforms)
+	};
+	Render_BufferUpload(manager->draws.localUniformBuffer[index], &uniformUpdate);
+}
+
+void MeshModRender_EncodeDraw(MeshModRender_Manager* manager, Render_GraphicsEncoderHandle encoder, uint32_t index, uint32_t viewCount) {
+	MeshModRender_DrawData const& draws = manager->draws;
+
+	Render_GraphicsEncoderBindDescriptorSet(encoder, draws.descriptorSet[index], 0);
+	Render_GraphicsEncoderBindVertexBuffer(encoder, draws.vertexBuffer[index], 0);
+	// the bound view set starts at the draws first view, so the first instance is
+	// always 0 which SV_InstanceID doesn't include on every api
+	Render_GraphicsEncoderDrawInstanced(encoder, draws.vertexCount[index], 0, viewCount, 0);
+}
+
+namespace {
+
+enum EncodePass {
+	EP_MAIN,
+	EP_DEPTH_PREPASS,
+	EP_AFTER_PREPASS,
+};
+
+struct BatchState {
+	MeshModRender_Manager* manager;
+	uint32_t count;
+	// NULL if unsorted, otherwise the batch position to draw at each step
+	uint32_t const* order;
+	bool depthPrepass;
+	MeshModRender_LocalUniforms const* uniforms;
+	// the view ring slot and view count when the batch was prepared
+	uint32_t viewSlot;
+	uint32_t viewCount;
+	// NULL unless culling per view, otherwise the views each draw is in
+	uint32_t const* viewMasks;
+};
+
+// matrices per job when computing a batches uniforms on the workers
+uint32_t const UniformsPerJob = 256;
+
+// the first view in the mask and how many views up to the last one, views in
+// between that the draw isn't in are still drawn as instances can't skip
+void ViewRange(uint32_t mask, uint32_t& firstView, uint32_t& viewCount) {
+	firstView = 0;
+	while(firstView < MMR_MAX_VIEWS && !(mask & (1u << firstView))) {
+		firstView++;
+	}
+	uint32_t lastView = MMR_MAX_VIEWS - 1;
+	while(lastView > firstView && !(mask & (1u << lastView))) {
+		lastView--;
+	}
+	viewCount = lastView - firstView + 1;
+}
+
+// fills manager->batchIndices with the draw index of each handle
+bool ResolveBatch(MeshModRender_Manager* manager, uint32_t count, MeshModRender_MeshHandle const* mrhandles) {
+	manager->batchIndices = (uint32_t*) MeshModRender_ScratchAlloc(manager->scratch, count * sizeof(uint32_t));
+	if(!manager->batchIndices) {
+		return false;
+	}
+
+	// resolve every handle once up front, after this only the dense arrays are touched
+	for(uint32_t i = 0; i < count; ++i) {
+		manager->batchIndices[i] = MeshModRender_LookupMesh(manager, mrhandles[i].handle)->drawIndex;
+	}
+	return true;
+}
+
+bool AllocSortArrays(MeshModRender_Manager* manager, uint32_t count) {
+	MeshModRender_Scratch& scratch = manager->scratch;
+	manager->batchKeys = (uint64_t*) MeshModRender_ScratchAlloc(scratch, count * sizeof(uint64_t));
+	manager->batchKeysTemp = (uint64_t*) MeshModRender_ScratchAlloc(scratch, count * sizeof(uint64_t));
+	manager->batchOrder = (uint32_t*) MeshModRender_ScratchAlloc(scratch, count * sizeof(uint32_t));
+	return manager->batchKeys && manager->batchKeysTemp && manager->batchOrder;
+}
+
+} // end anonymous namespace
+
+// LSD radix sort a byte at a time over the top 32 bits only, the low 32 bits hold
+// the batch position which is already in ascending order and the sort is stable.
+// Passes where every key has the same byte are skipped. Returns the sorted array
+// which is one of keys or temp.
+uint64_t* MeshModRender_RadixSortKeys(uint64_t* keys, uint64_t* temp, uint32_t count) {
+	for(uint32_t shift = 32; shift < 64; shift += 8) {
+		uint32_t histogram[256] = {0};
+		for(uint32_t i = 0; i < count; ++i) {
+			histogram[(keys[i] >> shift) & 0xFF]++;
+		}
+		if(histogram[(keys[0] >> shift) & 0xFF] == count) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for(uint32_t b = 0; b < 256; ++b) {
+			uint32_t const c = histogram[b];
+			histogram[b] = offset;
+			offset += c;
+		}
+		for(uint32_t i = 0; i < count; ++i) {
+			temp[histogram[(keys[i] >> shift) & 0xFF]++] = keys[i];
+		}
+
+		uint64_t* const swap = keys;
+		keys = temp;
+		temp = swap;
+	}
+	return keys;
+}
+
+// key is material sort id (8 bits) | quantised view depth (24 bits) | batch position (32 bits)
+// so draws are grouped by pipeline and then drawn front to back
+bool MeshModRender_BuildFrontToBackOrder(MeshModRender_Manager* manager,
+		uint32_t count,
+		Math_Mat4F const* localMatrices) {
+	if(!AllocSortArrays(manager, count)) {
+		return false;
+	}
+
+	MeshModRender_DrawData const& draws = manager->draws;
+	float const* worldToView = manager->views[0].worldToViewMatrix.v;
+	float const* viewToNDC = manager->views[0].viewToNDCMatrix.v;
+
+	// view matrices are stored as uploaded (column major) and local matrices row major.
+	// Pick the sign that makes increasing depth mean further away for both left and
+	// right handed projections, from clip w for perspective or ndc z for ortho
+	float const clipWFromZ = viewToNDC[2 * 4 + 3];
+	float const depthSign = (clipWFromZ != 0.0f) ? (clipWFromZ > 0.0f ? 1.0f : -1.0f) :
+			(viewToNDC[2 * 4 + 2] >= 0.0f ? 1.0f : -1.0f);
+
+	// depths are parked in the temp key array until the range is known
+	auto depths = (float*) manager->batchKeysTemp;
+	float minDepth = 0.0f;
+	float maxDepth = 0.0f;
+	bool first = true;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		uint32_t const index = manager->batchIndices[i];
+		if(index == ~0u) {
+			depths[i] = 0.0f;
+			continue;
+		}
+
+		Math_Vec3F const& bmin = draws.localBoundsMin[index];
+		Math_Vec3F const& bmax = draws.localBoundsMax[index];
+		float const cx = (bmin.x + bmax.x) * 0.5f;
+		float const cy = (bmin.y + bmax.y) * 0.5f;
+		float const cz = (bmin.z + bmax.z) * 0.5f;
+
+		float const* l = localMatrices[i].v;
+		float const wx = l[0] * cx + l[1] * cy + l[2] * cz + l[3];
+		float const wy = l[4] * cx + l[5] * cy + l[6] * cz + l[7];
+		float const wz = l[8] * cx + l[9] * cy + l[10] * cz + l[11];
+
+		float const viewZ = worldToView[2] * wx + worldToView[6] * wy + worldToView[10] * wz + worldToView[14];
+		float const depth = viewZ * depthSign;
+		depths[i] = depth;
+
+		if(first) {
+			minDepth = maxDepth = depth;
+			first = false;
+		} else {
+			minDepth = depth < minDepth ? depth : minDepth;
+			maxDepth = depth > maxDepth ? depth : maxDepth;
+		}
+	}
+
+	float const range = maxDepth - minDepth;
+	float const scale = (range > 0.0f) ? (float) 0xFFFFFF / range : 0.0f;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		uint32_t const index = manager->batchIndices[i];
+		uint64_t sortId = 0xFF;
+		uint64_t depth = 0;
+		if(index != ~0u) {
+			sortId = manager->styleMaterial[draws.renderStyle[index]].sortId;
+			depth = (uint64_t) ((depths[i] - minDepth) * scale);
+			depth = depth > 0xFFFFFF ? 0xFFFFFF : depth;
+		}
+		manager->batchKeys[i] = (sortId << 56) | (depth << 32) | i;
+	}
+
+	uint64_t const* sorted = MeshModRender_RadixSortKeys(manager->batchKeys, manager->batchKeysTemp, count);
+	for(uint32_t i = 0; i < count; ++i) {
+		manager->batchOrder[i] = (uint32_t) sorted[i];
+	}
+	return true;
+}
+
+namespace {
+
+void EncodeRange(BatchState const& batch,
+		Render_GraphicsEncoderHandle encoder,
+		uint32_t begin,
+		uint32_t end,
+		EncodePass pass) {
+	MeshModRender_Manager* manager = batch.manager;
+
+	MeshModRender_RenderStyle currentStyle = MMR_MAX;
+	uint32_t currentFirstView = ~0u;
+	for(uint32_t i = begin; i < end; ++i) {
+		uint32_t const item = batch.order ? batch.order[i] : i;
+		uint32_t const index = manager->batchIndices[item];
+		if(index == ~0u) {
+			continue;
+		}
+		MeshModRender_RenderStyle const style = manager->draws.renderStyle[index];
+		MeshModRender_RenderStyleMaterial const& material = manager->styleMaterial[style];
+
+		uint32_t firstView = 0;
+		uint32_t viewCount = batch.viewCount;
+		if(batch.viewMasks) {
+			ViewRange(batch.viewMasks[item], firstView, viewCount);
+		}
+
+		// only rebind the material when the style changes
+		if(style != currentStyle) {
+			// with one view the shaders that don't write the target slice are enough
+			bool const multiView = batch.viewCount > 1;
+			switch(pass) {
+				case EP_MAIN:
+					Render_GraphicsEncoderBindPipeline(encoder, multiView ? material.multiViewPipeline : material.pipeline);
+					break;
+				case EP_DEPTH_PREPASS:
+					Render_GraphicsEncoderBindPipeline(encoder, multiView ? material.multiViewDepthPrepassPipeline : material.depthPrepassPipeline);
+					break;
+				case EP_AFTER_PREPASS:
+					Render_GraphicsEncoderBindPipeline(encoder, multiView ? material.multiViewAfterPrepassPipeline : material.afterPrepassPipeline);
+					break;
+			}
+			currentStyle = style;
+			currentFirstView = ~0u;
+		}
+		// and the views when the style or first view does
+		if(firstView != currentFirstView) {
+			Render_GraphicsEncoderBindDescriptorSet(encoder, material.descriptorSet, MeshModRender_ViewSetIndex(batch.viewSlot, firstView));
+			currentFirstView = firstView;
+		}
+
+		// uniforms are uploaded on the first pass that touches the draw
+		if(pass != EP_AFTER_PREPASS) {
+			MeshModRender_UploadLocalUniforms(manager, index, batch.uniforms[item]);
+		}
+		MeshModRender_EncodeDraw(manager, encoder, index, viewCount);
+	}
+}
+
+void EncodeBatchRange(BatchState const& batch, Render_GraphicsEncoderHandle encoder, uint32_t begin, uint32_t end) {
+	if(batch.depthPrepass) {
+		EncodeRange(batch, encoder, begin, end, EP_DEPTH_PREPASS);
+		EncodeRange(batch, encoder, begin, end, EP_AFTER_PREPASS);
+	} else {
+		EncodeRange(batch, encoder, begin, end, EP_MAIN);
+	}
+}
+
+struct UniformsJob {
+	Math_Mat4F const* localMatrices;
+	Math_Mat4F const* inverseLocalMatrices;
+	uint32_t count;
+	MeshModRender_LocalUniforms* uniforms;
+};
+
+void ComputeUniformsJob(void* data, uint32_t jobIndex) {
+	auto job = (UniformsJob const*) data;
+	uint32_t const begin = jobIndex * UniformsPerJob;
+	uint32_t const end = (begin + UniformsPerJob < job->count) ? begin + UniformsPerJob : job->count;
+	MeshModRender_ComputeLocalUniforms(job->localMatrices + begin,
+			job->inverseLocalMatrices ? job->inverseLocalMatrices + begin : nullptr,
+			end - begin,
+			job->uniforms + begin);
+}
+
+// the whole batches uniform blocks in one pass, spread over the workers if large
+bool ComputeBatchUniforms(MeshModRender_Manager* manager,
+		uint32_t count,
+		Math_Mat4F const* localMatrices,
+		Math_Mat4F const* inverseLocalMatrices) {
+	manager->batchUniforms = (MeshModRender_LocalUniforms*) MeshModRender_ScratchAlloc(manager->scratch, count * sizeof(MeshModRender_LocalUniforms));
+	if(!manager->batchUniforms) {
+		return false;
+	}
+
+	UniformsJob job = {
+			localMatrices,
+			inverseLocalMatrices,
+			count,
+			manager->batchUniforms
+	};
+	MeshModRender_WorkersParallelFor(manager->workers, (count + UniformsPerJob - 1) / UniformsPerJob, &ComputeUniformsJob, &job);
+	return true;
+}
+
+bool PrepareBatch(BatchState& batch,
+		MeshModRender_Manager* manager,
+		uint32_t flags,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices,
+		Math_Mat4F const* inverseLocalMatrices) {
+	if(!ResolveBatch(manager, count, mrhandles)) {
+		return false;
+	}
+	// hidden draws are marked like unbuilt ones so everything after skips them.
+	// The occlusion buffer only holds the first view
+	if((flags & MMR_BF_OCCLUSION_CULL) && manager->viewCount == 1) {
+		MeshModRender_OcclusionCullBatch(manager, count, localMatrices);
+	}
+	manager->batchViewMasks = nullptr;
+	if((flags & MMR_BF_FRUSTUM_CULL) && !MeshModRender_ViewCullBatch(manager, count, localMatrices)) {
+		return false;
+	}
+	if(!ComputeBatchUniforms(manager, count, localMatrices, inverseLocalMatrices)) {
+		return false;
+	}
+
+	batch.manager = manager;
+	batch.count = count;
+	batch.order = nullptr;
+	batch.depthPrepass = (flags & MMR_BF_DEPTH_PREPASS) && Render_ShaderHandleIsValid(manager->depthOnlyShader);
+	batch.uniforms = manager->batchUniforms;
+	batch.viewSlot = manager->viewSlot;
+	batch.viewCount = manager->viewCount;
+	batch.viewMasks = manager->batchViewMasks;
+
+	if((flags & MMR_BF_SORT_FRONT_TO_BACK) && count > 1) {
+		if(MeshModRender_BuildFrontToBackOrder(manager, count, localMatrices)) {
+			batch.order = manager->batchOrder;
+		}
+	}
+	return true;
+}
+
+} // end anonymous namespace
+
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatch(MeshModRender_Manager* manager,
+																									Render_GraphicsEncoderHandle encoder,
+																									uint32_t flags,
+																									uint32_t count,
+																									MeshModRender_MeshHandle const* mrhandles,
+																									Math_Mat4F const* localMatrices,
+																									Math_Mat4F const* inverseLocalMatrices) {
+	// every batch temporary comes from scratch and is given back as soon as it's encoded
+	MeshModRender_ScratchMark const mark = MeshModRender_ScratchGetMark(manager->scratch);
+	BatchState batch;
+	if(PrepareBatch(batch, manager, flags, count, mrhandles, localMatrices, inverseLocalMatrices)) {
+		EncodeBatchRange(batch, encoder, 0, count);
+	}
+	MeshModRender_ScratchRewind(manager->scratch, mark);
+}
+
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatchLocal(MeshModRender_Manager* manager,
+																											 Render_GraphicsEncoderHandle encoder,
+																											 uint32_t flags,
+																											 uint32_t count,
+																											 MeshModRender_MeshHandle const* mrhandles,
+																											 Math_Mat4F const* localMatrices) {
+	MeshModRender_MeshRenderBatch(manager, encoder, flags, count, mrhandles, localMatrices, nullptr);
+}
+
+namespace {
+struct ParallelEncode {
+	BatchState const* batch;
+	Render_GraphicsEncoderHandle const* encoders;
+	uint32_t encoderCount;
+};
+
+void ParallelEncodeJob(void* data, uint32_t encoderIndex) {
+	auto job = (ParallelEncode const*) data;
+	uint32_t const count = job->batch->count;
+
+	// even split, the first ranges take the remainder
+	uint32_t const perEncoder = count / job->encoderCount;
+	uint32_t const remainder = count % job->encoderCount;
+	uint32_t const begin = encoderIndex * perEncoder + (encoderIndex < remainder ? encoderIndex : remainder);
+	uint32_t const end = begin + perEncoder + (encoderIndex < remainder ? 1 : 0);
+
+	EncodeBatchRange(*job->batch, job->encoders[encoderIndex], begin, end);
+}
+} // end anonymous namespace
+
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatchParallel(MeshModRender_Manager* manager,
+																													Render_GraphicsEncoderHandle const* encoders,
+																													uint32_t encoderCount,
+																													uint32_t flags,
+																													uint32_t count,
+																													MeshModRender_MeshHandle const* mrhandles,
+																													Math_Mat4F const* localMatrices,
+																													Math_Mat4F const* inverseLocalMatrices) {
+	if(encoderCount == 0) {
+		return;
+	}
+
+	MeshModRender_ScratchMark const mark = MeshModRender_ScratchGetMark(manager->scratch);
+	BatchState batch;
+	if(!PrepareBatch(batch, manager, flags, count, mrhandles, localMatrices, inverseLocalMatrices)) {
+		MeshModRender_ScratchRewind(manager->scratch, mark);
+		return;
+	}
+
+	// each range binds its own material state as encoders don't share it. With a
+	// prepass each range lays down its own depth, later ranges still benefit from
+	// the depth of earlier ones as the encoders are submitted in order
+	ParallelEncode job = {
+			&batch,
+			encoders,
+			encoderCount
+	};
+	MeshModRender_WorkersParallelFor(manager->workers, encoderCount, &ParallelEncodeJob, &job);
+	MeshModRender_ScratchRewind(manager->scratch, mark);
+}
+
+AL2O3_EXTERN_C void MeshModRender_MeshRenderBatchLocalParallel(MeshModRender_Manager* manager,
+																															 Render_GraphicsEncoderHandle const* encoders,
+																															 uint32_t encoderCount,
+																															 uint32_t flags,
+																															 uint32_t count,
+																															 MeshModRender_MeshHandle const* mrhandles,
+																															 Math_Mat4F const* localMatrices) {
+	MeshModRender_MeshRenderBatchParallel(manager, encoders, encoderCount, flags, count, mrhandles, localMatrices, nullptr);
+}
@@ -0,0 +1,627 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_thread/atomic.h"
+
+#include "bvh.hpp"
+#include "workers.hpp"
+#include "allocators.hpp"
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MMR_BVH_SSE 1
+#include <xmmintrin.h>
+#else
+#define MMR_BVH_SSE 0
+#endif
+
+namespace {
+
+uint32_t const MaxLeafTriangles = 4;
+uint32_t const BinCount = 12;
+// below this many triangles the children are built on the calling thread
+uint32_t const ParallelBuildThreshold = 8 * 1024;
+// traversal stack held on the stack, deeper trees use a pooled one
+uint32_t const MaxTraversalDepth = 64;
+
+// 16 byte aligned so the bounds can be loaded straight into a register, the
+// last lane of each load is the following uint32 and is ignored
+struct alignas(16) BvhNode {
+	float boundsMin[3];
+	// internal: left child, the right child is the next node. leaf: packet index
+	uint32_t leftOrPacket;
+	float boundsMax[3];
+	// 0 for internal nodes
+	uint32_t triangleCount;
+};
+
+// up to 4 triangles in structure of arrays form, unused lanes have zero edges
+// so their determinant is zero and they never hit
+struct alignas(16) TrianglePacket {
+	float v0[3][4];
+	float e1[3][4];
+	float e2[3][4];
+	uint32_t triangle[4];
+};
+
+struct Bounds {
+	float min[3];
+	float max[3];
+
+	void Reset() {
+		min[0] = min[1] = min[2] = FLT_MAX;
+		max[0] = max[1] = max[2] = -FLT_MAX;
+	}
+
+	void Grow(float const* p) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = p[i] < min[i] ? p[i] : min[i];
+			max[i] = p[i] > max[i] ? p[i] : max[i];
+		}
+	}
+
+	void Grow(Bounds const& b) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = b.min[i] < min[i] ? b.min[i] : min[i];
+			max[i] = b.max[i] > max[i] ? b.max[i] : max[i];
+		}
+	}
+
+	float HalfArea() const {
+		if (min[0] > max[0]) {
+			return 0.0f;
+		}
+		float const dx = max[0] - min[0];
+		float const dy = max[1] - min[1];
+		float const dz = max[2] - min[2];
+		return dx * dy + dy * dz + dz * dx;
+	}
+};
+
+} // end anonymous namespace
+
+struct MeshModRender_Bvh {
+	MeshModRender_Pool* pool;
+	uint32_t triangleCount;
+	// of the deepest leaf, the root is 0. Traversal never holds more than this + 1 nodes
+	uint32_t maxDepth;
+	uint32_t nodeCount;
+	BvhNode* nodes;
+	uint32_t packetCount;
+	TrianglePacket* packets;
+};
+
+namespace {
+
+struct BuildContext {
+	MeshModRender_Workers* workers;
+	BvhNode* nodes;
+	Thread_Atomic32_t nodeCount;
+
+	Bounds const* triangleBounds;
+	float const* centroids;
+	uint32_t* order;
+};
+
+struct BuildTask {
+	BuildContext* ctx;
+	uint32_t node;
+	uint32_t first;
+	uint32_t count;
+	uint32_t depth;
+	// filled in by the job, the depth of the deepest leaf under node
+	uint32_t maxDepth;
+};
+
+uint32_t BuildNode(BuildContext* ctx, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth);
+
+void BuildChildJob(void* data, uint32_t index) {
+	BuildTask& task = ((BuildTask*) data)[index];
+	task.maxDepth = BuildNode(task.ctx, task.node, task.first, task.count, task.depth);
+}
+
+void MakeLeaf(BvhNode& node, uint32_t first, uint32_t count) {
+	// packets are assigned after the build, until then point at the order array
+	node.leftOrPacket = first;
+	node.triangleCount = count;
+}
+
+// returns the depth of the deepest leaf under the node
+uint32_t BuildNode(BuildContext* ctx, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth) {
+	BvhNode& node = ctx->nodes[nodeIndex];
+
+	Bounds bounds;
+	Bounds centroidBounds;
+	bounds.Reset();
+	centroidBounds.Reset();
+	for (uint32_t i = first; i < first + count; ++i) {
+		uint32_t const tri = ctx->order[i];
+		bounds.Grow(ctx->triangleBounds[tri]);
+		centroidBounds.Grow(ctx->centroids + tri * 3);
+	}
+	memcpy(node.boundsMin, bounds.min, sizeof(float) * 3);
+	memcpy(node.boundsMax, bounds.max, sizeof(float) * 3);
+
+	if (count <= MaxLeafTriangles) {
+		MakeLeaf(node, first, count);
+		return depth;
+	}
+
+	// binned SAH over all three axes
+	int bestAxis = -1;
+	uint32_t bestBin = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis) {
+		float const extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+		float const scale = (float) BinCount / extent;
+
+		Bounds binBounds[BinCount];
+		uint32_t binCounts[BinCount] = {};
+		for (uint32_t b = 0; b < BinCount; ++b) {
+			binBounds[b].Reset();
+		}
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t const tri = ctx->order[i];
+			uint32_t bin = (uint32_t) ((ctx->centroids[tri * 3 + axis] - centroidBounds.min[axis]) * scale);
+			bin = bin < BinCount ? bin : BinCount - 1;
+			binCounts[bin]++;
+			binBounds[bin].Grow(ctx->triangleBounds[tri]);
+		}
+
+		// sweep from the right to get the cost of everything right of each plane
+		float rightArea[BinCount];
+		uint32_t rightCount[BinCount];
+		Bounds sweep;
+		sweep.Reset();
+		uint32_t sweepCount = 0;
+		for (uint32_t b = BinCount - 1; b > 0; --b) {
+			sweep.Grow(binBounds[b]);
+			sweepCount += binCounts[b];
+			rightArea[b] = sweep.HalfArea();
+			rightCount[b] = sweepCount;
+		}
+
+		sweep.Reset();
+		sweepCount = 0;
+		for (uint32_t b = 0; b < BinCount - 1; ++b) {
+			sweep.Grow(binBounds[b]);
+			sweepCount += binCounts[b];
+			if (sweepCount == 0 || rightCount[b + 1] == 0) {
+				continue;
+			}
+			float const cost = sweepCount * sweep.HalfArea() + rightCount[b + 1] * rightArea[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	uint32_t leftCount;
+	if (bestAxis >= 0) {
+		float const scale = (float) BinCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+		uint32_t* left = ctx->order + first;
+		uint32_t* right = ctx->order + first + count - 1;
+		while (left <= right) {
+			uint32_t bin = (uint32_t) ((ctx->centroids[*left * 3 + bestAxis] - centroidBounds.min[bestAxis]) * scale);
+			bin = bin < BinCount ? bin : BinCount - 1;
+			if (bin <= bestBin) {
+				left++;
+			} else {
+				uint32_t const tmp = *left;
+				*left = *right;
+				*right-- = tmp;
+			}
+		}
+		leftCount = (uint32_t) (left - (ctx->order + first));
+	} else {
+		// every centroid is in the same place, any split is as good as another
+		leftCount = count / 2;
+	}
+
+	uint32_t const leftIndex = Thread_AtomicFetchAdd32Relaxed(&ctx->nodeCount, 2);
+	node.leftOrPacket = leftIndex;
+	node.triangleCount = 0;
+
+	BuildTask tasks[2] = {
+			{ ctx, leftIndex, first, leftCount, depth + 1, 0 },
+			{ ctx, leftIndex + 1, first + leftCount, count - leftCount, depth + 1, 0 },
+	};
+	if (ctx->workers && count >= ParallelBuildThreshold) {
+		MeshModRender_WorkersParallelFor(ctx->workers, 2, &BuildChildJob, tasks);
+	} else {
+		BuildChildJob(tasks, 0);
+		BuildChildJob(tasks, 1);
+	}
+	return tasks[0].maxDepth > tasks[1].maxDepth ? tasks[0].maxDepth : tasks[1].maxDepth;
+}
+
+void FillPacket(TrianglePacket& packet, Math_Vec3F const* positions) {
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		if (packet.triangle[lane] == ~0u) {
+			for (int a = 0; a < 3; ++a) {
+				packet.v0[a][lane] = 0.0f;
+				packet.e1[a][lane] = 0.0f;
+				packet.e2[a][lane] = 0.0f;
+			}
+			continue;
+		}
+		Math_Vec3F const* v = positions + packet.triangle[lane] * 3;
+		float const p0[3] = { v[0].x, v[0].y, v[0].z };
+		float const p1[3] = { v[1].x, v[1].y, v[1].z };
+		float const p2[3] = { v[2].x, v[2].y, v[2].z };
+		for (int a = 0; a < 3; ++a) {
+			packet.v0[a][lane] = p0[a];
+			packet.e1[a][lane] = p1[a] - p0[a];
+			packet.e2[a][lane] = p2[a] - p0[a];
+		}
+	}
+}
+
+void RefitNodes(MeshModRender_Bvh* bvh, Math_Vec3F const* positions) {
+	// children are always allocated after their parent so a reverse walk sees
+	// both children before the parent
+	for (uint32_t i = bvh->nodeCount; i-- > 0;) {
+		BvhNode& node = bvh->nodes[i];
+		Bounds bounds;
+		bounds.Reset();
+		if (node.triangleCount) {
+			TrianglePacket const& packet = bvh->packets[node.leftOrPacket];
+			for (uint32_t lane = 0; lane < node.triangleCount; ++lane) {
+				Math_Vec3F const* v = positions + packet.triangle[lane] * 3;
+				for (int j = 0; j < 3; ++j) {
+					float const p[3] = { v[j].x, v[j].y, v[j].z };
+					bounds.Grow(p);
+				}
+			}
+		} else {
+			BvhNode const& left = bvh->nodes[node.leftOrPacket];
+			BvhNode const& right = bvh->nodes[node.leftOrPacket + 1];
+			bounds.Grow(left.boundsMin);
+			bounds.Grow(left.boundsMax);
+			bounds.Grow(right.boundsMin);
+			bounds.Grow(right.boundsMax);
+		}
+		memcpy(node.boundsMin, bounds.min, sizeof(float) * 3);
+		memcpy(node.boundsMax, bounds.max, sizeof(float) * 3);
+	}
+}
+
+#if MMR_BVH_SSE
+bool RayBox(BvhNode const& node, __m128 origin, __m128 invDir, float tMax, float& tEntry) {
+	__m128 const t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMin), origin), invDir);
+	__m128 const t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMax), origin), invDir);
+	__m128 const tNear = _mm_min_ps(t0, t1);
+	__m128 const tFar = _mm_max_ps(t0, t1);
+
+	// horizontal over xyz only, w is the node index lane
+	__m128 n = _mm_max_ss(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 1, 1, 1)));
+	n = _mm_max_ss(n, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 2, 2, 2)));
+	__m128 f = _mm_min_ss(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 1, 1, 1)));
+	f = _mm_min_ss(f, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 2, 2, 2)));
+
+	float const entry = _mm_cvtss_f32(n);
+	float const exit = _mm_cvtss_f32(f);
+	tEntry = entry > 0.0f ? entry : 0.0f;
+	return tEntry <= exit && entry < tMax;
+}
+
+// moller trumbore on all 4 lanes at once, returns the lane mask of hits closer than tMax
+int RayPacket(TrianglePacket const& packet, float const* origin, float const* dir, float tMax, __m128& t) {
+	__m128 const ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+	__m128 const dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+	__m128 const e1x = _mm_load_ps(packet.e1[0]), e1y = _mm_load_ps(packet.e1[1]), e1z = _mm_load_ps(packet.e1[2]);
+	__m128 const e2x = _mm_load_ps(packet.e2[0]), e2y = _mm_load_ps(packet.e2[1]), e2z = _mm_load_ps(packet.e2[2]);
+
+	// p = dir x e2
+	__m128 const px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 const py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 const pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 const det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 const absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 const invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 const sx = _mm_sub_ps(ox, _mm_load_ps(packet.v0[0]));
+	__m128 const sy = _mm_sub_ps(oy, _mm_load_ps(packet.v0[1]));
+	__m128 const sz = _mm_sub_ps(oz, _mm_load_ps(packet.v0[2]));
+	__m128 const u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+	// q = s x e1
+	__m128 const qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 const qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 const qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 const v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+	t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+	__m128 const zero = _mm_setzero_ps();
+	__m128 hit = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+	return _mm_movemask_ps(hit);
+}
+#else
+bool RayBox(BvhNode const& node, float const* origin, float const* invDir, float tMax, float& tEntry) {
+	float entry = -FLT_MAX;
+	float exit = FLT_MAX;
+	for (int a = 0; a < 3; ++a) {
+		float t0 = (node.boundsMin[a] - origin[a]) * invDir[a];
+		float t1 = (node.boundsMax[a] - origin[a]) * invDir[a];
+		if (t0 > t1) {
+			float const tmp = t0;
+			t0 = t1;
+			t1 = tmp;
+		}
+		entry = t0 > entry ? t0 : entry;
+		exit = t1 < exit ? t1 : exit;
+	}
+	tEntry = entry > 0.0f ? entry : 0.0f;
+	return tEntry <= exit && entry < tMax;
+}
+
+int RayPacket(TrianglePacket const& packet, float const* origin, float const* dir, float tMax, float* t) {
+	int mask = 0;
+	for (int lane = 0; lane < 4; ++lane) {
+		float const e1[3] = { packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane] };
+		float const e2[3] = { packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane] };
+		float const p[3] = {
+				dir[1] * e2[2] - dir[2] * e2[1],
+				dir[2] * e2[0] - dir[0] * e2[2],
+				dir[0] * e2[1] - dir[1] * e2[0]
+		};
+		float const det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		if (fabsf(det) <= 1e-12f) {
+			continue;
+		}
+		float const invDet = 1.0f / det;
+		float const s[3] = {
+				origin[0] - packet.v0[0][lane],
+				origin[1] - packet.v0[1][lane],
+				origin[2] - packet.v0[2][lane]
+		};
+		float const u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+		float const q[3] = {
+				s[1] * e1[2] - s[2] * e1[1],
+				s[2] * e1[0] - s[0] * e1[2],
+				s[0] * e1[1] - s[1] * e1[0]
+		};
+		float const v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * invDet;
+		t[lane] = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t[lane] >= 0.0f && t[lane] < tMax) {
+			mask |= 1 << lane;
+		}
+	}
+	return mask;
+}
+#endif
+
+} // end anonymous namespace
+
+MeshModRender_Bvh* MeshModRender_BvhCreate(MeshModRender_Workers* workers,
+		MeshModRender_Pool* pool,
+		Math_Vec3F const* positions,
+		uint32_t triangleCount) {
+	if (triangleCount == 0) {
+		return nullptr;
+	}
+
+	auto bvh = (MeshModRender_Bvh*) MeshModRender_PoolAlloc(*pool, sizeof(MeshModRender_Bvh));
+	if (!bvh) {
+		return nullptr;
+	}
+	memset(bvh, 0, sizeof(MeshModRender_Bvh));
+	bvh->pool = pool;
+	bvh->triangleCount = triangleCount;
+	// a binary tree with at least one triangle per leaf never needs more than this
+	bvh->nodes = (BvhNode*) MeshModRender_PoolAlloc(*pool, sizeof(BvhNode) * (2 * triangleCount - 1));
+
+	// build temporaries are pooled too, rebuilds of similar sized meshes reuse them
+	auto triangleBounds = (Bounds*) MeshModRender_PoolAlloc(*pool, sizeof(Bounds) * triangleCount);
+	auto centroids = (float*) MeshModRender_PoolAlloc(*pool, sizeof(float) * 3 * triangleCount);
+	auto order = (uint32_t*) MeshModRender_PoolAlloc(*pool, sizeof(uint32_t) * triangleCount);
+	if (!bvh->nodes || !triangleBounds || !centroids || !order) {
+		MeshModRender_PoolFree(*pool, triangleBounds);
+		MeshModRender_PoolFree(*pool, centroids);
+		MeshModRender_PoolFree(*pool, order);
+		MeshModRender_BvhDestroy(bvh);
+		return nullptr;
+	}
+
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		Bounds& b = triangleBounds[i];
+		b.Reset();
+		for (int j = 0; j < 3; ++j) {
+			Math_Vec3F const& v = positions[i * 3 + j];
+			float const p[3] = { v.x, v.y, v.z };
+			b.Grow(p);
+		}
+		for (int a = 0; a < 3; ++a) {
+			centroids[i * 3 + a] = (b.min[a] + b.max[a]) * 0.5f;
+		}
+		order[i] = i;
+	}
+
+	BuildContext ctx;
+	ctx.workers = workers;
+	ctx.nodes = bvh->nodes;
+	Thread_AtomicStore32Relaxed(&ctx.nodeCount, 1);
+	ctx.triangleBounds = triangleBounds;
+	ctx.centroids = centroids;
+	ctx.order = order;
+	bvh->maxDepth = BuildNode(&ctx, 0, 0, triangleCount, 0);
+	bvh->nodeCount = Thread_AtomicLoad32Relaxed(&ctx.nodeCount);
+
+	// leaves mostly hold several triangles so size the packets from the tree
+	// rather than one per triangle
+	uint32_t leafCount = 0;
+	for (uint32_t i = 0; i < bvh->nodeCount; ++i) {
+		leafCount += bvh->nodes[i].triangleCount ? 1 : 0;
+	}
+	bvh->packets = (TrianglePacket*) MeshModRender_PoolAlloc(*pool, sizeof(TrianglePacket) * leafCount);
+	if (!bvh->packets) {
+		MeshModRender_PoolFree(*pool, order);
+		MeshModRender_PoolFree(*pool, centroids);
+		MeshModRender_PoolFree(*pool, triangleBounds);
+		MeshModRender_BvhDestroy(bvh);
+		return nullptr;
+	}
+
+	// now the tree is done turn each leafs range of the order array into a packet
+	for (uint32_t i = 0; i < bvh->nodeCount; ++i) {
+		BvhNode& node = bvh->nodes[i];
+		if (node.triangleCount == 0) {
+			continue;
+		}
+		TrianglePacket& packet = bvh->packets[bvh->packetCount];
+		for (uint32_t lane = 0; lane < 4; ++lane) {
+			packet.triangle[lane] = lane < node.triangleCount ? order[node.leftOrPacket + lane] : ~0u;
+		}
+		FillPacket(packet, positions);
+		node.leftOrPacket = bvh->packetCount++;
+	}
+
+	MeshModRender_PoolFree(*pool, order);
+	MeshModRender_PoolFree(*pool, centroids);
+	MeshModRender_PoolFree(*pool, triangleBounds);
+	return bvh;
+}
+
+void MeshModRender_BvhDestroy(MeshModRender_Bvh* bvh) {
+	if (!bvh) {
+		return;
+	}
+	MeshModRender_Pool& pool = *bvh->pool;
+	MeshModRender_PoolFree(pool, bvh->packets);
+	MeshModRender_PoolFree(pool, bvh->nodes);
+	MeshModRender_PoolFree(pool, bvh);
+}
+
+MeshModRender_Bvh* MeshModRender_BvhClone(MeshModRender_Bvh const* bvh) {
+	if (!bvh) {
+		return nullptr;
+	}
+	MeshModRender_Pool& pool = *bvh->pool;
+	auto clone = (MeshModRender_Bvh*) MeshModRender_PoolAlloc(pool, sizeof(MeshModRender_Bvh));
+	if (!clone) {
+		return nullptr;
+	}
+	*clone = *bvh;
+	clone->nodes = (BvhNode*) MeshModRender_PoolAlloc(pool, sizeof(BvhNode) * bvh->nodeCount);
+	clone->packets = (TrianglePacket*) MeshModRender_PoolAlloc(pool, sizeof(TrianglePacket) * bvh->packetCount);
+	if (!clone->nodes || !clone->packets) {
+		MeshModRender_BvhDestroy(clone);
+		return nullptr;
+	}
+	memcpy(clone->nodes, bvh->nodes, sizeof(BvhNode) * bvh->nodeCount);
+	memcpy(clone->packets, bvh->packets, sizeof(TrianglePacket) * bvh->packetCount);
+	return clone;
+}
+
+bool MeshModRender_BvhRefit(MeshModRender_Bvh* bvh, Math_Vec3F const* positions, uint32_t triangleCount) {
+	if (!bvh || bvh->triangleCount != triangleCount) {
+		return false;
+	}
+	for (uint32_t i = 0; i < bvh->packetCount; ++i) {
+		FillPacket(bvh->packets[i], positions);
+	}
+	RefitNodes(bvh, positions);
+	return true;
+}
+
+bool MeshModRender_BvhIntersect(MeshModRender_Bvh const* bvh,
+		Math_Vec3F const& origin,
+		Math_Vec3F const& direction,
+		float maxT,
+		float& hitT,
+		uint32_t& hitTriangle) {
+	if (!bvh) {
+		return false;
+	}
+
+	float const o[3] = { origin.x, origin.y, origin.z };
+	float const d[3] = { direction.x, direction.y, direction.z };
+	// a zero component gives +-inf which the slab test handles
+	float const invD[3] = { 1.0f / d[0], 1.0f / d[1], 1.0f / d[2] };
+#if MMR_BVH_SSE
+	__m128 const origin4 = _mm_set_ps(0.0f, o[2], o[1], o[0]);
+	__m128 const invDir4 = _mm_set_ps(0.0f, invD[2], invD[1], invD[0]);
+#define MMR_RAYBOX(node, entry) RayBox(node, origin4, invDir4, bestT, entry)
+#else
+#define MMR_RAYBOX(node, entry) RayBox(node, o, invD, bestT, entry)
+#endif
+
+	float bestT = maxT;
+	uint32_t bestTriangle = ~0u;
+
+	// a bad split can make the tree deeper than SAH usually gives, the depth is
+	// known from the build so the stack is always big enough
+	uint32_t localStack[MaxTraversalDepth];
+	uint32_t* stack = localStack;
+	if (bvh->maxDepth + 1 > MaxTraversalDepth) {
+		stack = (uint32_t*) MeshModRender_PoolAlloc(*bvh->pool, sizeof(uint32_t) * (bvh->maxDepth + 1));
+		if (!stack) {
+			LOGWARNING("BVH out of memory for a %u deep traversal stack", bvh->maxDepth + 1);
+			return false;
+		}
+	}
+	uint32_t stackSize = 0;
+	float entry;
+	if (MMR_RAYBOX(bvh->nodes[0], entry)) {
+		stack[stackSize++] = 0;
+	}
+
+	while (stackSize) {
+		BvhNode const& node = bvh->nodes[stack[--stackSize]];
+
+		if (node.triangleCount) {
+			TrianglePacket const& packet = bvh->packets[node.leftOrPacket];
+#if MMR_BVH_SSE
+			__m128 t4;
+			int mask = RayPacket(packet, o, d, bestT, t4);
+			alignas(16) float t[4];
+			_mm_store_ps(t, t4);
+#else
+			float t[4];
+			int mask = RayPacket(packet, o, d, bestT, t);
+#endif
+			for (uint32_t lane = 0; mask; ++lane, mask >>= 1) {
+				if ((mask & 1) && t[lane] < bestT) {
+					bestT = t[lane];
+					bestTriangle = packet.triangle[lane];
+				}
+			}
+			continue;
+		}
+
+		// push the further child first so the nearer one is visited next
+		uint32_t const left = node.leftOrPacket;
+		float leftEntry, rightEntry;
+		bool const hitLeft = MMR_RAYBOX(bvh->nodes[left], leftEntry);
+		bool const hitRight = MMR_RAYBOX(bvh->nodes[left + 1], rightEntry);
+		if (hitLeft && hitRight) {
+			ASSERT(stackSize + 2 <= bvh->maxDepth + 1);
+			bool const leftFirst = leftEntry <= rightEntry;
+			stack[stackSize++] = leftFirst ? left + 1 : left;
+			stack[stackSize++] = leftFirst ? left : left + 1;
+		} else if (hitLeft || hitRight) {
+			stack[stackSize++] = hitLeft ? left : left + 1;
+		}
+	}
+#undef MMR_RAYBOX
+
+	if (stack != localStack) {
+		MeshModRender_PoolFree(*bvh->pool, stack);
+	}
+	if (bestTriangle == ~0u) {
+		return false;
+	}
+	hitT = bestT;
+	hitTriangle = bestTriangle;
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "al2o3_platform/platform.h"
+#include "al2o3_cmath/vector.h"
+
+struct MeshModRender_Workers;
+struct MeshModRender_Pool;
+
+// a binned SAH bounding volume hierarchy over a triangle soup, leaves hold up to
+// 4 triangles packed so a leaf is tested against a ray in one SIMD packet
+struct MeshModRender_Bvh;
+
+// positions are 3 per triangle, the bvh keeps its own copy in packet form. All
+// its memory comes from the pool, which must outlive it
+MeshModRender_Bvh* MeshModRender_BvhCreate(MeshModRender_Workers* workers,
+		MeshModRender_Pool* pool,
+		Math_Vec3F const* positions,
+		uint32_t triangleCount);
+void MeshModRender_BvhDestroy(MeshModRender_Bvh* bvh);
+
+// an independent copy from the same pool, so one can be refitted while the other is still read
+MeshModRender_Bvh* MeshModRender_BvhClone(MeshModRender_Bvh const* bvh);
+
+// moves the triangles and refits the existing tree, only valid when the triangle
+// count and order is unchanged. Returns false if it can't refit
+bool MeshModRender_BvhRefit(MeshModRender_Bvh* bvh, Math_Vec3F const* positions, uint32_t triangleCount);
+
+// closest hit along origin + t * direction for t in [0, maxT)
+bool MeshModRender_BvhIntersect(MeshModRender_Bvh const* bvh,
+		Math_Vec3F const& origin,
+		Math_Vec3F const& direction,
+		float maxT,
+		float& hitT,
+		uint32_t& hitTriangle);
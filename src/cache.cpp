@@ -0,0 +1,648 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_memory/memory.h"
+#include "al2o3_thread/thread.h"
+#include "al2o3_thread/atomic.h"
+#include "al2o3_cadt/vector.h"
+
+#include "cache.hpp"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint32_t const CacheFileMagic = 0x43524d4d; // MMRC
+uint32_t const CacheIndexMagic = 0x49524d4d; // MMRI
+uint32_t const CacheJournalMagic = 0x4a524d4d; // MMRJ
+
+// vertex data starts straight after the header, 80 bytes keeps it 16 byte aligned
+struct CacheFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t posHash;
+	uint64_t normalHash;
+	uint64_t topologyHash;
+	uint32_t style;
+	uint32_t vertexSize;
+	uint32_t vertexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t pad[3];
+};
+static_assert(sizeof(CacheFileHeader) == 80, "Cache file header should be 80 bytes");
+
+struct CacheIndexHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t clock;
+	uint64_t entryCount;
+};
+
+struct CacheEntry {
+	MeshModRender_CacheKey key;
+	uint64_t fileSize;
+	uint64_t lastUse;
+};
+
+// the lru order, appended to on every use. A record is stale once its entry has
+// been used again or removed, those are skipped when evicting
+struct CacheUse {
+	uint64_t lastUse;
+	MeshModRender_CacheKey key;
+};
+
+// the index is only rewritten at create and destroy, every change in between is
+// appended to the journal so a crash loses at most a torn last record. Lookups
+// aren't journaled so after a crash the lru order is as of the last write
+struct CacheJournalHeader {
+	uint32_t magic;
+	uint32_t version;
+};
+
+enum CacheJournalOp : uint32_t {
+	CJO_ADD,
+	CJO_REMOVE
+};
+
+struct CacheJournalRecord {
+	CacheJournalOp op;
+	uint32_t pad;
+	CacheEntry entry;
+};
+
+int CompareKeys(MeshModRender_CacheKey const& a, MeshModRender_CacheKey const& b) {
+	if(a.posHash != b.posHash) {
+		return a.posHash < b.posHash ? -1 : 1;
+	}
+	if(a.normalHash != b.normalHash) {
+		return a.normalHash < b.normalHash ? -1 : 1;
+	}
+	if(a.topologyHash != b.topologyHash) {
+		return a.topologyHash < b.topologyHash ? -1 : 1;
+	}
+	if(a.style != b.style) {
+		return a.style < b.style ? -1 : 1;
+	}
+	if(a.vertexSize != b.vertexSize) {
+		return a.vertexSize < b.vertexSize ? -1 : 1;
+	}
+	return 0;
+}
+
+} // end anonymous namespace
+
+struct MeshModRender_Cache {
+	// lookups and writes may come from build workers
+	Thread_Mutex lock;
+
+	char directory[512];
+	uint64_t maxBytes;
+	uint64_t totalBytes;
+	uint64_t clock;
+	// numbers the temporary files of writers in this process
+	Thread_Atomic32_t writeCounter;
+	// open for appending while the cache is alive
+	FILE* journal;
+
+	// sorted by key for binary search
+	CADT_VectorHandle entries;
+	// oldest first from usesHead, rebuilt from entries when mostly stale
+	CADT_VectorHandle uses;
+	size_t usesHead;
+};
+
+static void EntryPath(MeshModRender_Cache const* cache, MeshModRender_CacheKey const& key, char const* extension, char* path, size_t pathSize) {
+	snprintf(path, pathSize, "%s/%016llx%016llx%016llx_%u_%u.%s",
+					 cache->directory,
+					 (unsigned long long) key.posHash,
+					 (unsigned long long) key.normalHash,
+					 (unsigned long long) key.topologyHash,
+					 key.style,
+					 key.vertexSize,
+					 extension);
+}
+
+// the process id keeps other processes sharing the directory out of the way
+static void TempPath(MeshModRender_Cache* cache, char* path, size_t pathSize) {
+#if defined(_WIN32)
+	unsigned int const processId = (unsigned int) GetCurrentProcessId();
+#else
+	unsigned int const processId = (unsigned int) getpid();
+#endif
+	snprintf(path, pathSize, "%s/write_%x_%x.tmp",
+					 cache->directory,
+					 processId,
+					 Thread_AtomicFetchAdd32Relaxed(&cache->writeCounter, 1));
+}
+
+// replaces any existing file at path in one step, readers see the old or new file never neither
+static bool RenameOver(char const* tmpPath, char const* path) {
+#if defined(_WIN32)
+	return MoveFileExA(tmpPath, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(tmpPath, path) == 0;
+#endif
+}
+
+static void IndexPath(MeshModRender_Cache const* cache, char* path, size_t pathSize) {
+	snprintf(path, pathSize, "%s/index.mmri", cache->directory);
+}
+
+static void JournalPath(MeshModRender_Cache const* cache, char* path, size_t pathSize) {
+	snprintf(path, pathSize, "%s/index.mmrj", cache->directory);
+}
+
+// must hold the lock, flushed so it survives the process going down
+static void AppendJournal(MeshModRender_Cache* cache, CacheJournalOp op, CacheEntry const& entry) {
+	if(!cache->journal) {
+		return;
+	}
+	CacheJournalRecord record{};
+	record.op = op;
+	record.entry = entry;
+	if(fwrite(&record, sizeof(record), 1, cache->journal) != 1 || fflush(cache->journal) != 0) {
+		LOGWARNING("MeshModRender unable to append to the cache journal, changes will be saved on destroy");
+		fclose(cache->journal);
+		cache->journal = nullptr;
+	}
+}
+
+// returns the entry or where it would be inserted in index with found false
+static size_t FindEntry(MeshModRender_Cache* cache, MeshModRender_CacheKey const& key, bool& found) {
+	size_t lo = 0;
+	size_t hi = CADT_VectorSize(cache->entries);
+	while(lo < hi) {
+		size_t const mid = (lo + hi) / 2;
+		int const cmp = CompareKeys(((CacheEntry*) CADT_VectorAt(cache->entries, mid))->key, key);
+		if(cmp == 0) {
+			found = true;
+			return mid;
+		}
+		if(cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	found = false;
+	return lo;
+}
+
+// adds or replaces the entry for its key
+static void SetEntry(MeshModRender_Cache* cache, CacheEntry const& entry) {
+	bool found;
+	size_t const index = FindEntry(cache, entry.key, found);
+	if(found) {
+		CacheEntry* existing = (CacheEntry*) CADT_VectorAt(cache->entries, index);
+		cache->totalBytes -= existing->fileSize;
+		*existing = entry;
+	} else {
+		size_t const count = CADT_VectorSize(cache->entries);
+		CADT_VectorResize(cache->entries, count + 1);
+		CacheEntry* entries = (CacheEntry*) CADT_VectorData(cache->entries);
+		memmove(entries + index + 1, entries + index, (count - index) * sizeof(CacheEntry));
+		entries[index] = entry;
+	}
+	cache->totalBytes += entry.fileSize;
+}
+
+// forgets the entry without touching its file
+static void DropEntry(MeshModRender_Cache* cache, size_t index) {
+	CacheEntry* entries = (CacheEntry*) CADT_VectorData(cache->entries);
+	size_t const count = CADT_VectorSize(cache->entries);
+
+	cache->totalBytes -= entries[index].fileSize;
+	memmove(entries + index, entries + index + 1, (count - index - 1) * sizeof(CacheEntry));
+	CADT_VectorResize(cache->entries, count - 1);
+}
+
+static void RemoveEntry(MeshModRender_Cache* cache, size_t index) {
+	CacheEntry const entry = *(CacheEntry*) CADT_VectorAt(cache->entries, index);
+
+	char path[1024];
+	EntryPath(cache, entry.key, "mmrc", path, sizeof(path));
+	remove(path);
+
+	AppendJournal(cache, CJO_REMOVE, entry);
+	DropEntry(cache, index);
+}
+
+static int CompareUses(void const* a, void const* b) {
+	uint64_t const lastUseA = ((CacheUse const*) a)->lastUse;
+	uint64_t const lastUseB = ((CacheUse const*) b)->lastUse;
+	return lastUseA < lastUseB ? -1 : (lastUseA > lastUseB ? 1 : 0);
+}
+
+// one record per entry in lru order, O(n log n) but only once the stale records
+// outnumber the entries so amortised over as many uses
+static void RebuildUses(MeshModRender_Cache* cache) {
+	size_t const count = CADT_VectorSize(cache->entries);
+	CADT_VectorResize(cache->uses, count);
+	for(size_t i = 0; i < count; ++i) {
+		CacheEntry const* entry = (CacheEntry const*) CADT_VectorAt(cache->entries, i);
+		CacheUse* use = (CacheUse*) CADT_VectorAt(cache->uses, i);
+		use->lastUse = entry->lastUse;
+		use->key = entry->key;
+	}
+	if(count > 1) {
+		qsort(CADT_VectorData(cache->uses), count, sizeof(CacheUse), &CompareUses);
+	}
+	cache->usesHead = 0;
+}
+
+// must hold the lock, call after setting the entries lastUse
+static void TouchEntry(MeshModRender_Cache* cache, CacheEntry const& entry) {
+	if(CADT_VectorSize(cache->uses) > 2 * CADT_VectorSize(cache->entries) + 64) {
+		RebuildUses(cache);
+		return;
+	}
+	CacheUse const use = {
+			entry.lastUse,
+			entry.key
+	};
+	CADT_VectorPushElement(cache->uses, &use);
+}
+
+// must hold the lock
+static void EvictToFit(MeshModRender_Cache* cache) {
+	while(cache->totalBytes > cache->maxBytes &&
+			CADT_VectorSize(cache->entries) > 1 &&
+			cache->usesHead < CADT_VectorSize(cache->uses)) {
+		CacheUse const use = *(CacheUse const*) CADT_VectorAt(cache->uses, cache->usesHead++);
+		bool found;
+		size_t const index = FindEntry(cache, use.key, found);
+		if(found && ((CacheEntry const*) CADT_VectorAt(cache->entries, index))->lastUse == use.lastUse) {
+			RemoveEntry(cache, index);
+		}
+	}
+}
+
+static void LoadIndex(MeshModRender_Cache* cache) {
+	char path[1024];
+	IndexPath(cache, path, sizeof(path));
+	FILE* file = fopen(path, "rb");
+	if(!file) {
+		return;
+	}
+
+	CacheIndexHeader header;
+	if(fread(&header, sizeof(header), 1, file) == 1 &&
+			header.magic == CacheIndexMagic &&
+			header.version == MeshModRender_CacheFormatVersion) {
+		CADT_VectorResize(cache->entries, (size_t) header.entryCount);
+		if(fread(CADT_VectorData(cache->entries), sizeof(CacheEntry), (size_t) header.entryCount, file) == header.entryCount) {
+			cache->clock = header.clock;
+			for(size_t i = 0; i < CADT_VectorSize(cache->entries); ++i) {
+				cache->totalBytes += ((CacheEntry*) CADT_VectorAt(cache->entries, i))->fileSize;
+			}
+		} else {
+			CADT_VectorResize(cache->entries, 0);
+		}
+	}
+	fclose(file);
+}
+
+// replays the changes made since the index was last saved, stops at a torn record
+static void ReplayJournal(MeshModRender_Cache* cache) {
+	char path[1024];
+	JournalPath(cache, path, sizeof(path));
+	FILE* file = fopen(path, "rb");
+	if(!file) {
+		return;
+	}
+
+	CacheJournalHeader header;
+	if(fread(&header, sizeof(header), 1, file) == 1 &&
+			header.magic == CacheJournalMagic &&
+			header.version == MeshModRender_CacheFormatVersion) {
+		CacheJournalRecord record;
+		while(fread(&record, sizeof(record), 1, file) == 1) {
+			if(record.op == CJO_ADD) {
+				SetEntry(cache, record.entry);
+			} else if(record.op == CJO_REMOVE) {
+				bool found;
+				size_t const index = FindEntry(cache, record.entry.key, found);
+				if(found) {
+					DropEntry(cache, index);
+				}
+			} else {
+				break;
+			}
+			cache->clock = record.entry.lastUse > cache->clock ? record.entry.lastUse : cache->clock;
+		}
+	}
+	fclose(file);
+}
+
+// written aside and renamed over the old index so a crash part way through
+// leaves the old index and journal, which still replay to the same entries
+static bool SaveIndex(MeshModRender_Cache* cache) {
+	char tmpPath[1024];
+	char path[1024];
+	TempPath(cache, tmpPath, sizeof(tmpPath));
+	IndexPath(cache, path, sizeof(path));
+	FILE* file = fopen(tmpPath, "wb");
+	if(!file) {
+		LOGWARNING("MeshModRender unable to write cache index %s", tmpPath);
+		return false;
+	}
+
+	CacheIndexHeader const header = {
+			CacheIndexMagic,
+			MeshModRender_CacheFormatVersion,
+			cache->clock,
+			CADT_VectorSize(cache->entries)
+	};
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(CADT_VectorData(cache->entries), sizeof(CacheEntry), CADT_VectorSize(cache->entries), file) ==
+					CADT_VectorSize(cache->entries);
+	ok = (fclose(file) == 0) && ok;
+	if(!ok || !RenameOver(tmpPath, path)) {
+		LOGWARNING("MeshModRender unable to write cache index %s", path);
+		remove(tmpPath);
+		return false;
+	}
+	return true;
+}
+
+// the saved index holds everything so the journal starts again empty
+static void ResetJournal(MeshModRender_Cache* cache) {
+	if(cache->journal) {
+		fclose(cache->journal);
+	}
+	char path[1024];
+	JournalPath(cache, path, sizeof(path));
+	cache->journal = fopen(path, "wb");
+	if(!cache->journal) {
+		LOGWARNING("MeshModRender unable to open cache journal %s, changes will be saved on destroy", path);
+		return;
+	}
+	CacheJournalHeader const header = {
+			CacheJournalMagic,
+			MeshModRender_CacheFormatVersion
+	};
+	if(fwrite(&header, sizeof(header), 1, cache->journal) != 1 || fflush(cache->journal) != 0) {
+		fclose(cache->journal);
+		cache->journal = nullptr;
+	}
+}
+
+MeshModRender_Cache* MeshModRender_CacheCreate(char const* directory, uint64_t maxBytes) {
+	auto cache = (MeshModRender_Cache*) MEMORY_CALLOC(1, sizeof(MeshModRender_Cache));
+	if(!cache) {
+		return nullptr;
+	}
+
+	snprintf(cache->directory, sizeof(cache->directory), "%s", directory);
+	cache->maxBytes = maxBytes;
+	cache->entries = CADT_VectorCreate(sizeof(CacheEntry));
+	cache->uses = CADT_VectorCreate(sizeof(CacheUse));
+	Thread_MutexCreate(&cache->lock);
+
+	LoadIndex(cache);
+	ReplayJournal(cache);
+	RebuildUses(cache);
+	// the cap may have shrunk since the index was written
+	EvictToFit(cache);
+	// fold the journal into the index, if that fails keep appending to the old one
+	if(SaveIndex(cache)) {
+		ResetJournal(cache);
+	} else {
+		char path[1024];
+		JournalPath(cache, path, sizeof(path));
+		cache->journal = fopen(path, "ab");
+		if(cache->journal && fseek(cache->journal, 0, SEEK_END) == 0 && ftell(cache->journal) == 0) {
+			// nothing to keep, start it with a header
+			ResetJournal(cache);
+		}
+	}
+
+	return cache;
+}
+
+void MeshModRender_CacheDestroy(MeshModRender_Cache* cache) {
+	if(!cache) {
+		return;
+	}
+
+	if(cache->journal) {
+		fclose(cache->journal);
+	}
+	// the journal goes only once the index has everything in it
+	if(SaveIndex(cache)) {
+		char path[1024];
+		JournalPath(cache, path, sizeof(path));
+		remove(path);
+	}
+	CADT_VectorDestroy(cache->entries);
+	CADT_VectorDestroy(cache->uses);
+	Thread_MutexDestroy(&cache->lock);
+	MEMORY_FREE(cache);
+}
+
+static bool MapFile(char const* path, MeshModRender_CacheMapping& mapping) {
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!fileMapping) {
+		CloseHandle(file);
+		return false;
+	}
+	void* base = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if(!base) {
+		CloseHandle(fileMapping);
+		CloseHandle(file);
+		return false;
+	}
+	mapping.base = base;
+	mapping.size = (size_t) size.QuadPart;
+	mapping.file = file;
+	mapping.mapping = fileMapping;
+#else
+	int const fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* base = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file alive
+	close(fd);
+	if(base == MAP_FAILED) {
+		return false;
+	}
+	madvise(base, (size_t) st.st_size, MADV_SEQUENTIAL);
+	mapping.base = base;
+	mapping.size = (size_t) st.st_size;
+	mapping.file = nullptr;
+	mapping.mapping = nullptr;
+#endif
+	return true;
+}
+
+void MeshModRender_CacheReleaseMapping(MeshModRender_CacheMapping& mapping) {
+	if(!mapping.base) {
+		return;
+	}
+#if defined(_WIN32)
+	UnmapViewOfFile(mapping.base);
+	CloseHandle((HANDLE) mapping.mapping);
+	CloseHandle((HANDLE) mapping.file);
+#else
+	munmap(mapping.base, mapping.size);
+#endif
+	memset(&mapping, 0, sizeof(MeshModRender_CacheMapping));
+}
+
+bool MeshModRender_CacheLookup(MeshModRender_Cache* cache, MeshModRender_CacheKey const& key, MeshModRender_CacheMapping& mapping) {
+	memset(&mapping, 0, sizeof(MeshModRender_CacheMapping));
+
+	Thread_MutexAcquire(&cache->lock);
+	bool found;
+	size_t const index = FindEntry(cache, key, found);
+	if(!found) {
+		Thread_MutexRelease(&cache->lock);
+		return false;
+	}
+
+	char path[1024];
+	EntryPath(cache, key, "mmrc", path, sizeof(path));
+	if(!MapFile(path, mapping)) {
+		// deleted behind our back, forget it
+		RemoveEntry(cache, index);
+		Thread_MutexRelease(&cache->lock);
+		return false;
+	}
+
+	auto header = (CacheFileHeader const*) mapping.base;
+	bool const valid = mapping.size >= sizeof(CacheFileHeader) &&
+			header->magic == CacheFileMagic &&
+			header->version == MeshModRender_CacheFormatVersion &&
+			header->posHash == key.posHash &&
+			header->normalHash == key.normalHash &&
+			header->topologyHash == key.topologyHash &&
+			header->style == key.style &&
+			header->vertexSize == key.vertexSize &&
+			mapping.size >= sizeof(CacheFileHeader) + (size_t) header->vertexCount * header->vertexSize;
+	if(!valid) {
+		MeshModRender_CacheReleaseMapping(mapping);
+		RemoveEntry(cache, index);
+		Thread_MutexRelease(&cache->lock);
+		return false;
+	}
+
+	CacheEntry* entry = (CacheEntry*) CADT_VectorAt(cache->entries, index);
+	entry->lastUse = ++cache->clock;
+	TouchEntry(cache, *entry);
+	Thread_MutexRelease(&cache->lock);
+
+	mapping.vertices = header + 1;
+	mapping.vertexCount = header->vertexCount;
+	memcpy(&mapping.boundsMin, header->boundsMin, sizeof(float) * 3);
+	memcpy(&mapping.boundsMax, header->boundsMax, sizeof(float) * 3);
+	return true;
+}
+
+bool MeshModRender_CacheBeginWrite(MeshModRender_Cache* cache, MeshModRender_CacheKey const& key, uint32_t vertexCount, MeshModRender_CacheWriter& writer) {
+	memset(&writer, 0, sizeof(MeshModRender_CacheWriter));
+
+	uint64_t const fileSize = sizeof(CacheFileHeader) + (uint64_t) vertexCount * key.vertexSize;
+	if(fileSize > cache->maxBytes) {
+		return false;
+	}
+
+	TempPath(cache, writer.tmpPath, sizeof(writer.tmpPath));
+	writer.file = fopen(writer.tmpPath, "wb");
+	if(!writer.file) {
+		return false;
+	}
+	writer.key = key;
+	writer.vertexCount = vertexCount;
+
+	// bounds are filled in once the vertices have all been seen
+	CacheFileHeader header{};
+	fwrite(&header, sizeof(header), 1, writer.file);
+	return true;
+}
+
+void MeshModRender_CacheWrite(MeshModRender_CacheWriter& writer, void const* data, size_t size) {
+	if(!writer.file || writer.failed) {
+		return;
+	}
+	if(fwrite(data, 1, size, writer.file) != size) {
+		writer.failed = true;
+	}
+}
+
+void MeshModRender_CacheEndWrite(MeshModRender_Cache* cache, MeshModRender_CacheWriter& writer, Math_Vec3F const& boundsMin, Math_Vec3F const& boundsMax) {
+	if(!writer.file) {
+		return;
+	}
+
+	CacheFileHeader header{};
+	header.magic = CacheFileMagic;
+	header.version = MeshModRender_CacheFormatVersion;
+	header.posHash = writer.key.posHash;
+	header.normalHash = writer.key.normalHash;
+	header.topologyHash = writer.key.topologyHash;
+	header.style = writer.key.style;
+	header.vertexSize = writer.key.vertexSize;
+	header.vertexCount = writer.vertexCount;
+	memcpy(header.boundsMin, &boundsMin, sizeof(float) * 3);
+	memcpy(header.boundsMax, &boundsMax, sizeof(float) * 3);
+
+	if(fseek(writer.file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer.file) != 1) {
+		writer.failed = true;
+	}
+	writer.failed = (fclose(writer.file) != 0) || writer.failed;
+	writer.file = nullptr;
+
+	char path[1024];
+	EntryPath(cache, writer.key, "mmrc", path, sizeof(path));
+
+	if(writer.failed) {
+		remove(writer.tmpPath);
+		return;
+	}
+
+	uint64_t const fileSize = sizeof(CacheFileHeader) + (uint64_t) writer.vertexCount * writer.key.vertexSize;
+
+	Thread_MutexAcquire(&cache->lock);
+	if(!RenameOver(writer.tmpPath, path)) {
+		remove(writer.tmpPath);
+		Thread_MutexRelease(&cache->lock);
+		return;
+	}
+	CacheEntry const entry = {
+			writer.key,
+			fileSize,
+			++cache->clock
+	};
+	// the file was replaced above so an existing entry just takes the new values
+	SetEntry(cache, entry);
+	TouchEntry(cache, entry);
+	AppendJournal(cache, CJO_ADD, entry);
+
+	EvictToFit(cache);
+	Thread_MutexRelease(&cache->lock);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "al2o3_platform/platform.h"
+#include "al2o3_cmath/vector.h"
+
+#include <stdio.h>
+
+// an on disk cache of built vertex buffers, one file per entry laid out so a hit
+// can be memory mapped and uploaded directly from the mapped pages
+struct MeshModRender_Cache;
+
+// bump whenever the vertex generation or file layout changes
+static uint32_t const MeshModRender_CacheFormatVersion = 2;
+
+struct MeshModRender_CacheKey {
+	uint64_t posHash;
+	uint64_t normalHash;
+	// the triangle connectivity and polygon ids, the vertex hashes alone miss
+	// edits that only rewire faces
+	uint64_t topologyHash;
+	uint32_t style;
+	uint32_t vertexSize;
+};
+
+struct MeshModRender_CacheMapping {
+	void const* vertices;
+	uint32_t vertexCount;
+	Math_Vec3F boundsMin;
+	Math_Vec3F boundsMax;
+
+	// platform mapping state
+	void* base;
+	size_t size;
+	void* file;
+	void* mapping;
+};
+
+struct MeshModRender_CacheWriter {
+	FILE* file;
+	// unique to this writer so concurrent builds of the same key never share it
+	char tmpPath[1024];
+	MeshModRender_CacheKey key;
+	uint32_t vertexCount;
+	bool failed;
+};
+
+MeshModRender_Cache* MeshModRender_CacheCreate(char const* directory, uint64_t maxBytes);
+void MeshModRender_CacheDestroy(MeshModRender_Cache* cache);
+
+bool MeshModRender_CacheLookup(MeshModRender_Cache* cache, MeshModRender_CacheKey const& key, MeshModRender_CacheMapping& mapping);
+void MeshModRender_CacheReleaseMapping(MeshModRender_CacheMapping& mapping);
+
+// entries are written to a temporary file and only become visible on a successful end
+bool MeshModRender_CacheBeginWrite(MeshModRender_Cache* cache, MeshModRender_CacheKey const& key, uint32_t vertexCount, MeshModRender_CacheWriter& writer);
+void MeshModRender_CacheWrite(MeshModRender_CacheWriter& writer, void const* data, size_t size);
+void MeshModRender_CacheEndWrite(MeshModRender_Cache* cache, MeshModRender_CacheWriter& writer, Math_Vec3F const& boundsMin, Math_Vec3F const& boundsMax);
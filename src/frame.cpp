@@ -0,0 +1,220 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_memory/memory.h"
+#include "render_meshmodrender/render.h"
+#include "render_basics/buffer.h"
+#include "render_basics/descriptorset.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+
+#include <stdlib.h>
+
+static Thread_Atomic32_t ShardCounter;
+
+static uint32_t ThreadShard() {
+	static thread_local uint32_t shard = ~0u;
+	if(shard == ~0u) {
+		shard = Thread_AtomicFetchAdd32Relaxed(&ShardCounter, 1) % MeshModRender_CommandQueueShards;
+	}
+	return shard;
+}
+
+static void ReleaseNow(Render_RendererHandle renderer, MeshModRender_Release const& release) {
+	switch(release.type) {
+		case MMR_RELEASE_BUFFER:
+			Render_BufferDestroy(renderer, release.buffer);
+			break;
+		case MMR_RELEASE_DESCRIPTOR_SET:
+			Render_DescriptorSetDestroy(renderer, release.descriptorSet);
+			break;
+	}
+}
+
+static void Release(MeshModRender_Manager* manager, MeshModRender_Release const& release) {
+	if(manager->framesInFlight == 0) {
+		ReleaseNow(manager->renderer, release);
+		return;
+	}
+	uint32_t const slot = (uint32_t) (manager->frameIndex % (manager->framesInFlight + 1));
+	CADT_VectorPushElement(manager->pendingReleases[slot], &release);
+}
+
+static void ReleaseSlot(MeshModRender_Manager* manager, uint32_t slot) {
+	CADT_VectorHandle releases = manager->pendingReleases[slot];
+	if(!releases) {
+		return;
+	}
+	for(size_t i = 0; i < CADT_VectorSize(releases); ++i) {
+		ReleaseNow(manager->renderer, *(MeshModRender_Release*) CADT_VectorAt(releases, i));
+	}
+	CADT_VectorResize(releases, 0);
+}
+
+void MeshModRender_ReleaseBuffer(MeshModRender_Manager* manager, Render_BufferHandle buffer) {
+	if(!Render_BufferHandleIsValid(buffer)) {
+		return;
+	}
+	MeshModRender_Release release;
+	release.type = MMR_RELEASE_BUFFER;
+	release.buffer = buffer;
+	Release(manager, release);
+}
+
+void MeshModRender_ReleaseDescriptorSet(MeshModRender_Manager* manager, Render_DescriptorSetHandle descriptorSet) {
+	if(!Render_DescriptorSetHandleIsValid(descriptorSet)) {
+		return;
+	}
+	MeshModRender_Release release;
+	release.type = MMR_RELEASE_DESCRIPTOR_SET;
+	release.descriptorSet = descriptorSet;
+	Release(manager, release);
+}
+
+void MeshModRender_ReleaseAll(MeshModRender_Manager* manager) {
+	for(uint32_t i = 0; i <= MeshModRender_MaxFramesInFlight; ++i) {
+		ReleaseSlot(manager, i);
+		if(manager->pendingReleases[i]) {
+			CADT_VectorDestroy(manager->pendingReleases[i]);
+			manager->pendingReleases[i] = nullptr;
+		}
+	}
+}
+
+bool MeshModRender_CommandQueuesCreate(MeshModRender_Manager* manager) {
+	for(uint32_t i = 0; i <= manager->framesInFlight; ++i) {
+		manager->pendingReleases[i] = CADT_VectorCreate(sizeof(MeshModRender_Release));
+		if(!manager->pendingReleases[i]) {
+			return false;
+		}
+	}
+
+	if(!manager->concurrent) {
+		return true;
+	}
+
+	if(!Thread_MutexCreate(&manager->handleLock)) {
+		return false;
+	}
+	for(uint32_t i = 0; i < MeshModRender_CommandQueueShards; ++i) {
+		MeshModRender_CommandQueue& queue = manager->commandQueues[i];
+		queue.commands = CADT_VectorCreate(sizeof(MeshModRender_Command));
+		if(!queue.commands || !Thread_MutexCreate(&queue.lock)) {
+			return false;
+		}
+	}
+	manager->drainCommands = CADT_VectorCreate(sizeof(MeshModRender_Command));
+	return manager->drainCommands != nullptr;
+}
+
+void MeshModRender_CommandQueuesDestroy(MeshModRender_Manager* manager) {
+	if(!manager->concurrent) {
+		return;
+	}
+
+	for(uint32_t i = 0; i < MeshModRender_CommandQueueShards; ++i) {
+		MeshModRender_CommandQueue& queue = manager->commandQueues[i];
+		if(queue.commands) {
+			CADT_VectorDestroy(queue.commands);
+			Thread_MutexDestroy(&queue.lock);
+		}
+	}
+	if(manager->drainCommands) {
+		CADT_VectorDestroy(manager->drainCommands);
+	}
+	Thread_MutexDestroy(&manager->handleLock);
+}
+
+void MeshModRender_CommandPush(MeshModRender_Manager* manager, MeshModRender_Command& command) {
+	MeshModRender_CommandQueue& queue = manager->commandQueues[ThreadShard()];
+	Thread_MutexAcquire(&queue.lock);
+	// numbered under the lock so nothing later numbered can be drained first
+	command.sequence = Thread_AtomicFetchAdd32Relaxed(&manager->commandSequence, 1);
+	CADT_VectorPushElement(queue.commands, &command);
+	Thread_MutexRelease(&queue.lock);
+}
+
+static int CompareCommandSequence(void const* a, void const* b) {
+	// difference rather than compare so the sequence counter can wrap
+	int32_t const diff = (int32_t) (((MeshModRender_Command const*) a)->sequence - ((MeshModRender_Command const*) b)->sequence);
+	return diff < 0 ? -1 : (diff > 0 ? 1 : 0);
+}
+
+uint32_t MeshModRender_CommandCollect(MeshModRender_Manager* manager) {
+	CADT_VectorHandle drain = manager->drainCommands;
+	CADT_VectorResize(drain, 0);
+
+	// lock every shard before taking any so the snapshot has no sequence gaps
+	for(uint32_t i = 0; i < MeshModRender_CommandQueueShards; ++i) {
+		Thread_MutexAcquire(&manager->commandQueues[i].lock);
+	}
+	for(uint32_t i = 0; i < MeshModRender_CommandQueueShards; ++i) {
+		MeshModRender_CommandQueue& queue = manager->commandQueues[i];
+		size_t const count = CADT_VectorSize(queue.commands);
+		if(count) {
+			size_t const base = CADT_VectorSize(drain);
+			CADT_VectorResize(drain, base + count);
+			memcpy(CADT_VectorAt(drain, base), CADT_VectorData(queue.commands), count * sizeof(MeshModRender_Command));
+			CADT_VectorResize(queue.commands, 0);
+		}
+	}
+	for(uint32_t i = 0; i < MeshModRender_CommandQueueShards; ++i) {
+		Thread_MutexRelease(&manager->commandQueues[i].lock);
+	}
+
+	size_t const count = CADT_VectorSize(drain);
+	if(count) {
+		qsort(CADT_VectorData(drain), count, sizeof(MeshModRender_Command), &CompareCommandSequence);
+	}
+	return (uint32_t) count;
+}
+
+void MeshModRender_CommandDrain(MeshModRender_Manager* manager) {
+	CADT_VectorHandle drain = manager->drainCommands;
+	uint32_t const count = MeshModRender_CommandCollect(manager);
+	for(uint32_t i = 0; i < count; ++i) {
+		MeshModRender_Command const& command = *(MeshModRender_Command*) CADT_VectorAt(drain, i);
+		switch(command.type) {
+			case MMR_CMD_CREATE:
+				MeshModRender_ApplyMeshCreate(manager, command.handle);
+				break;
+			case MMR_CMD_DESTROY:
+				MeshModRender_ApplyMeshDestroy(manager, command.handle);
+				break;
+			case MMR_CMD_SET_STYLE:
+				MeshModRender_ApplyMeshSetStyle(manager, command.handle, command.style);
+				break;
+			case MMR_CMD_UPDATE:
+			case MMR_CMD_UPDATE_ASYNC:
+				Thread_AtomicFetchAdd32Relaxed(&MeshModRender_LookupMesh(manager, command.handle)->queuedUpdates, (uint32_t) -1);
+				MeshModRender_ApplyMeshUpdateSnapshot(manager, command.handle, command.mesh);
+				break;
+			case MMR_CMD_SET_RETAIN_CPU_COPY:
+				MeshModRender_ApplyMeshSetRetainCpuCopy(manager, command.handle, command.retain);
+				break;
+			case MMR_CMD_SET_PICKABLE:
+				MeshModRender_ApplyMeshSetPickable(manager, command.handle, command.pickable);
+				break;
+		}
+	}
+}
+
+AL2O3_EXTERN_C void MeshModRender_ManagerBeginFrame(MeshModRender_Manager* manager) {
+	manager->frameIndex++;
+	MeshModRender_ScratchReset(manager->scratch);
+	if(manager->frameIndex % MeshModRender_PoolTrimFrames == 0) {
+		MeshModRender_PoolTrim(manager->pool);
+	}
+	manager->viewSetsThisFrame = 0;
+	manager->viewRingOverflowWarned = false;
+
+	// this slot was last filled framesInFlight + 1 frames ago so the gpu is done with it
+	if(manager->framesInFlight) {
+		ReleaseSlot(manager, (uint32_t) (manager->frameIndex % (manager->framesInFlight + 1)));
+	}
+
+	if(manager->concurrent) {
+		MeshModRender_CommandDrain(manager);
+	}
+
+	MeshModRender_AsyncBuildsPoll(manager);
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "al2o3_handle/handle.h"
+#include "al2o3_thread/thread.h"
+#include "al2o3_thread/atomic.h"
+#include "al2o3_cadt/vector.h"
+#include "render_basics/api.h"
+#include "render_basics/view.h"
+#include "al2o3_cmath/matrix.h"
+#include "render_meshmodrender/render.h"
+#include "meshrenderable.hpp"
+#include "workers.hpp"
+#include "cache.hpp"
+#include "allocators.hpp"
+#include "occlusionbuffer.hpp"
+
+struct MeshModRender_RenderStyleMaterial {
+	Render_ShaderHandle shader;
+	Render_RootSignatureHandle rootSignature;
+	Render_PipelineHandle pipeline;
+	Render_DescriptorSetHandle descriptorSet;
+
+	Render_PipelineHandle depthPrepassPipeline;
+	Render_PipelineHandle afterPrepassPipeline;
+
+	// write SV_RenderTargetArrayIndex, only valid if multi view is supported
+	Render_ShaderHandle multiViewShader;
+	Render_PipelineHandle multiViewPipeline;
+	Render_PipelineHandle multiViewDepthPrepassPipeline;
+	Render_PipelineHandle multiViewAfterPrepassPipeline;
+
+	uint8_t sortId;
+	bool copyDontFree;
+};
+
+union MeshModRender_LocalUniforms {
+	struct {
+		Math_Mat4F localToWorld;
+		Math_Mat4F localToWorldTranspose;
+	};
+
+	uint8_t spacer[UNIFORM_BUFFER_MIN_SIZE];
+};
+
+// a whole uniform block so a descriptor can start at any view
+union MeshModRender_ViewUniform {
+	struct {
+		Math_Mat4F worldToViewMatrix;
+		Math_Mat4F viewToNDCMatrix;
+		Math_Mat4F worldToNDCMatrix;
+		uint32_t viewIndex;
+	};
+
+	uint8_t spacer[UNIFORM_BUFFER_MIN_SIZE];
+};
+
+struct MeshModRender_ViewUniforms {
+	MeshModRender_ViewUniform views[MMR_MAX_VIEWS];
+};
+
+// shaders index views from SV_InstanceID, so draws needing fewer views start further in
+inline uint32_t MeshModRender_ViewSetIndex(uint32_t slot, uint32_t firstView) {
+	return slot * MMR_MAX_VIEWS + firstView;
+}
+
+// past this many view changes a frame, draws already encoded may see later views
+static uint32_t const MeshModRender_ViewSetsPerFrame = 4;
+
+// indexed by drawIndex, kept dense as destroy swaps the last entry into the hole
+struct MeshModRender_DrawData {
+	uint32_t count;
+	uint32_t capacity;
+
+	Render_BufferHandle* vertexBuffer;
+	uint32_t* vertexCount;
+	Render_DescriptorSetHandle* descriptorSet;
+	Render_BufferHandle* localUniformBuffer;
+	MeshModRender_RenderStyle* renderStyle;
+	Math_Vec3F* localBoundsMin;
+	Math_Vec3F* localBoundsMax;
+	Handle_Handle32* owner;
+};
+
+enum MeshModRender_CommandType {
+	MMR_CMD_CREATE,
+	MMR_CMD_DESTROY,
+	MMR_CMD_SET_STYLE,
+	MMR_CMD_UPDATE,
+	MMR_CMD_SET_RETAIN_CPU_COPY,
+	MMR_CMD_SET_PICKABLE,
+	MMR_CMD_UPDATE_ASYNC,
+};
+
+struct MeshModRender_Command {
+	uint32_t sequence;
+	MeshModRender_CommandType type;
+	Handle_Handle32 handle;
+	union {
+		MeshMod_MeshHandle mesh;
+		MeshModRender_RenderStyle style;
+		bool retain;
+		bool pickable;
+	};
+};
+
+static uint32_t const MeshModRender_CommandQueueShards = 8;
+
+struct MeshModRender_CommandQueue {
+	Thread_Mutex lock;
+	CADT_VectorHandle commands;
+};
+
+enum MeshModRender_ReleaseType {
+	MMR_RELEASE_BUFFER,
+	MMR_RELEASE_DESCRIPTOR_SET,
+};
+
+struct MeshModRender_Release {
+	MeshModRender_ReleaseType type;
+	union {
+		Render_BufferHandle buffer;
+		Render_DescriptorSetHandle descriptorSet;
+	};
+};
+
+// the results belong to the job until remaining is 0
+struct MeshModRender_AsyncBuild {
+	MeshModRender_Manager* manager;
+	Handle_Handle32 handle;
+	bool orphaned;
+	uint32_t remaining;
+	MeshModRender_Workers* workers;
+
+	MeshMod_MeshHandle snapshot;
+	MeshModRender_RenderStyle style;
+	uint64_t posHash;
+	uint64_t normalHash;
+	uint64_t topologyHash;
+	bool pickable;
+	bool retainCpuCopy;
+	bool writeCache;
+
+	Render_BufferHandle vertexBuffer;
+	uint32_t vertexCount;
+	void* chunk;
+	MeshModRender_PoolArray vertices;
+	Math_Vec3F boundsMin;
+	Math_Vec3F boundsMax;
+
+	MeshModRender_PoolArray pickPositions;
+	MeshModRender_PoolArray pickPolygons;
+	MeshModRender_PoolArray pickPolygonIds;
+	bool pickHasPolygonIds;
+	uint64_t pickTopologyHash;
+	// a copy as picks may still be reading the live bvh
+	MeshModRender_Bvh* bvh;
+	uint64_t refitTopologyHash;
+	// scratch is render thread only
+	MeshModRender_PoolArray triangles;
+};
+
+static uint32_t const MeshModRender_MaxFramesInFlight = 4;
+
+static uint32_t const MeshModRender_AsyncBuildsFreeMax = 8;
+static size_t const MeshModRender_AsyncBuildKeepBytes = 1024 * 1024;
+
+static uint32_t const MeshModRender_PoolTrimFrames = 64;
+
+static uint32_t const MeshModRender_StreamChunkSize = 64 * 1024;
+
+static uint32_t const MeshModRender_DefaultScratchBytes = 256 * 1024;
+
+static uint64_t const MeshModRender_DefaultCacheMaxBytes = 256ull * 1024 * 1024;
+
+static uint32_t const MeshModRender_DefaultOcclusionWidth = 256;
+static uint32_t const MeshModRender_DefaultOcclusionHeight = 144;
+
+static uint32_t const MeshModRender_RenderableBlockSize = 256;
+static uint32_t const MeshModRender_RenderableMaxBlocks = 4096;
+
+struct MeshModRender_Manager {
+	// blocks never move, so handles resolve without a lock. Slot 0 is never handed out
+	MeshMod_MeshRenderable* renderableBlocks[MeshModRender_RenderableMaxBlocks];
+	uint32_t renderableCount;
+	CADT_VectorHandle freeRenderables;
+	Render_RendererHandle renderer;
+
+	bool concurrent;
+	uint32_t framesInFlight;
+	uint64_t frameIndex;
+
+	Thread_Mutex handleLock;
+	Thread_Atomic32_t commandSequence;
+	MeshModRender_CommandQueue commandQueues[MeshModRender_CommandQueueShards];
+	CADT_VectorHandle drainCommands;
+
+	CADT_VectorHandle pendingReleases[MeshModRender_MaxFramesInFlight + 1];
+
+	MeshModRender_DrawData draws;
+
+	MeshModRender_RenderStyleMaterial styleMaterial[MMR_MAX];
+	Render_ShaderHandle depthOnlyShader;
+	Render_ShaderHandle depthOnlyMultiViewShader;
+	bool multiView;
+
+	// views[0] drives sorting and occlusion
+	Render_GpuView views[MMR_MAX_VIEWS];
+	uint32_t viewCount;
+	// row major
+	Math_Mat4F viewWorldToClip[MMR_MAX_VIEWS];
+	Render_BufferHandle viewUniformBuffer;
+	uint32_t viewSlotCount;
+	uint32_t viewSlot;
+	uint32_t viewSetsThisFrame;
+	bool viewRingOverflowWarned;
+
+	MeshModRender_Workers* workers;
+	// used when workers has no threads
+	MeshModRender_Workers* asyncWorkers;
+	MeshModRender_Cache* cache;
+	MeshModRender_OcclusionBuffer* occlusion;
+	uint32_t occlusionWidth;
+	uint32_t occlusionHeight;
+	CADT_VectorHandle asyncBuilds;
+
+	MeshModRender_Heap heap;
+	MeshModRender_Scratch scratch;
+	MeshModRender_Pool pool;
+	CADT_VectorHandle asyncBuildsFree;
+
+	uint8_t* streamChunk;
+
+	// from scratch, rewound when the batch ends
+	uint32_t* batchIndices;
+	uint64_t* batchKeys;
+	uint64_t* batchKeysTemp;
+	uint32_t* batchOrder;
+	MeshModRender_LocalUniforms* batchUniforms;
+	// NULL when not culling per view
+	uint32_t* batchViewMasks;
+};
+
+// a handle only reaches another thread after its block is allocated
+inline MeshMod_MeshRenderable* MeshModRender_LookupMesh(MeshModRender_Manager* manager, Handle_Handle32 handle) {
+	return manager->renderableBlocks[handle / MeshModRender_RenderableBlockSize] + (handle % MeshModRender_RenderableBlockSize);
+}
+
+void MeshModRender_ReleaseBuffer(MeshModRender_Manager* manager, Render_BufferHandle buffer);
+void MeshModRender_ReleaseDescriptorSet(MeshModRender_Manager* manager, Render_DescriptorSetHandle descriptorSet);
+void MeshModRender_ReleaseAll(MeshModRender_Manager* manager);
+
+bool MeshModRender_CommandQueuesCreate(MeshModRender_Manager* manager);
+void MeshModRender_CommandQueuesDestroy(MeshModRender_Manager* manager);
+void MeshModRender_CommandPush(MeshModRender_Manager* manager, MeshModRender_Command& command);
+// fills drainCommands in sequence order without applying them
+uint32_t MeshModRender_CommandCollect(MeshModRender_Manager* manager);
+void MeshModRender_CommandDrain(MeshModRender_Manager* manager);
+
+// inverseLocalMatrices may be NULL
+void MeshModRender_ComputeLocalUniforms(Math_Mat4F const* localMatrices,
+		Math_Mat4F const* inverseLocalMatrices,
+		uint32_t count,
+		MeshModRender_LocalUniforms* uniforms);
+void MeshModRender_UploadLocalUniforms(MeshModRender_Manager* manager, uint32_t index, MeshModRender_LocalUniforms const& uniforms);
+// the material must already be bound
+void MeshModRender_EncodeDraw(MeshModRender_Manager* manager, Render_GraphicsEncoderHandle encoder, uint32_t index, uint32_t viewCount);
+bool MeshModRender_ViewRingCreate(MeshModRender_Manager* manager);
+Render_DescriptorSetHandle MeshModRender_ViewDescriptorSetCreate(MeshModRender_Manager* manager, Render_RootSignatureHandle rootSignature);
+uint32_t MeshModRender_ViewMaskForBounds(MeshModRender_Manager* manager,
+		Math_Mat4F const& localMatrix,
+		Math_Vec3F const& boundsMin,
+		Math_Vec3F const& boundsMax);
+// stable on the top 32 bits, returns whichever of keys or temp holds the result
+uint64_t* MeshModRender_RadixSortKeys(uint64_t* keys, uint64_t* temp, uint32_t count);
+bool MeshModRender_BuildFrontToBackOrder(MeshModRender_Manager* manager, uint32_t count, Math_Mat4F const* localMatrices);
+bool MeshModRender_ViewCullBatch(MeshModRender_Manager* manager, uint32_t count, Math_Mat4F const* localMatrices);
+
+void MeshModRender_ApplyMeshCreate(MeshModRender_Manager* manager, Handle_Handle32 handle);
+void MeshModRender_ApplyMeshDestroy(MeshModRender_Manager* manager, Handle_Handle32 handle);
+void MeshModRender_ApplyMeshSetStyle(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshModRender_RenderStyle style);
+void MeshModRender_ApplyMeshUpdate(MeshModRender_Manager* manager, Handle_Handle32 handle);
+void MeshModRender_ApplyMeshSetRetainCpuCopy(MeshModRender_Manager* manager, Handle_Handle32 handle, bool retain);
+void MeshModRender_ApplyMeshSetPickable(MeshModRender_Manager* manager, Handle_Handle32 handle, bool pickable);
+void MeshModRender_ApplyMeshUpdateAsync(MeshModRender_Manager* manager, Handle_Handle32 handle);
+// takes ownership of snapshot
+void MeshModRender_ApplyMeshUpdateSnapshot(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshMod_MeshHandle snapshot);
+void MeshModRender_PushMeshUpdate(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshModRender_CommandType type);
+
+// returns false if the hashes haven't changed
+bool MeshModRender_StoreHashesIfChanged(MeshMod_MeshRenderable* mr, MeshMod_MeshHandle source, MeshModRender_RenderStyle style);
+void MeshModRender_ComputeHashes(MeshMod_MeshHandle source);
+void MeshModRender_AsyncBuildRun(MeshModRender_AsyncBuild* build);
+void MeshModRender_AsyncBuildsPoll(MeshModRender_Manager* manager);
+void MeshModRender_AsyncBuildFinish(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh);
+void MeshModRender_AsyncBuildOrphan(MeshMod_MeshRenderable* mesh);
+void MeshModRender_AsyncBuildsDestroy(MeshModRender_Manager* manager);
+
+void MeshModRender_OcclusionCullBatch(MeshModRender_Manager* manager, uint32_t count, Math_Mat4F const* localMatrices);
+
+void MeshModRender_PickDataDestroy(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh);
+void MeshModRender_PickDataBuilt(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh, uint64_t topologyHash);
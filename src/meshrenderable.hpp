@@ -7,45 +7,68 @@
 #include "al2o3_cmath/vector.h"
 #include "al2o3_cmath/matrix.h"
 #include "render_basics/view.h"
+#include "al2o3_thread/atomic.h"
+#include "allocators.hpp"
 
+struct MeshModRender_Manager;
+struct MeshModRender_Bvh;
+struct MeshModRender_AsyncBuild;
+
+// cold build time data, the hot per draw data lives in the managers
+// MeshModRender_DrawData at drawIndex
 struct MeshMod_MeshRenderable {
 	MeshMod_MeshHandle MMMesh;
-	MeshModRender_RenderStyle renderStyle;
+	uint32_t drawIndex;
 
 	Render_RendererHandle renderer;
 
-	CADT_VectorHandle cpuVertexBuffer;
-	Render_BufferHandle gpuVertexBuffer;
-	uint32_t gpuVertexBufferCount;
+	// only valid if retainCpuCopy is set, otherwise vertices are streamed
+	// straight to the gpu and not kept around
+	bool retainCpuCopy;
+	MeshModRender_PoolArray cpuVertexBuffer;
+	uint32_t gpuVertexBufferCapacity;
 
 	uint64_t storedPosHash;
 	uint64_t storedNormalHash;
+	uint64_t storedTopologyHash;
+	// set once a build for the current style has gone to the cache, later
+	// rebuilds are edits and only read it
+	bool cacheWritten;
 
-	Render_DescriptorSetHandle descriptorSet;
-	union {
-		struct {
-			Math_Mat4F localToWorld;
-			Math_Mat4F localToWorldTranspose;
-		};
+	// only valid if pickable is set, captured from each build. 3 positions, the
+	// source polygon handle and a polygon id (or triangle index) per built triangle
+	bool pickable;
+	MeshModRender_PoolArray pickPositions;
+	MeshModRender_PoolArray pickPolygons;
+	MeshModRender_PoolArray pickPolygonIds;
+	bool pickHasPolygonIds;
+	// polygon handle hash of the last build, unchanged means only positions moved so refit
+	uint64_t pickTopologyHash;
+	MeshModRender_Bvh* bvh;
 
-		uint8_t spacer[UNIFORM_BUFFER_MIN_SIZE];
-	} localUniforms;
-	Render_BufferHandle localUniformBuffer;
+	// the background build in flight, if any. asyncPending is set when the mesh
+	// changed again while it ran, another build starts once it is swapped in
+	MeshModRender_AsyncBuild* asyncBuild;
+	bool asyncPending;
+	// concurrent only, the latest snapshot waiting for the in flight build
+	MeshMod_MeshHandle pendingSnapshot;
+	// update commands pushed from any thread and not yet drained, concurrent only
+	Thread_Atomic32_t queuedUpdates;
 };
 
 struct VertexPosNormal {
 	Math_Vec3F position;
 	Math_Vec3F normal;
 
-	static void UpdateIfNeeded(MeshMod_MeshRenderable* mr);
+	static void UpdateIfNeeded(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr);
 };
 
 struct VertexPosColour {
 	Math_Vec3F position;
 	uint32_t colour;
 
-	static void UpdateIfNeededFaceColours(MeshMod_MeshRenderable* mr);
-	static void UpdateIfNeededTriColours(MeshMod_MeshRenderable* mr);
+	static void UpdateIfNeededFaceColours(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr);
+	static void UpdateIfNeededTriColours(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr);
 };
 
 struct VertexPosNormalColour {
@@ -53,5 +76,5 @@ struct VertexPosNormalColour {
 	Math_Vec3F normal;
 	uint32_t colour;
 
-	static void UpdateIfNeeded(MeshMod_MeshRenderable* mr);
+	static void UpdateIfNeeded(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr);
 };
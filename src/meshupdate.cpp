@@ -7,12 +7,14 @@
 #include "render_meshmod/polygon/convexbrep.h"
 #include "render_meshmod/polygon/basicdata.h"
 #include "render_meshmod/edge/halfedge.h"
-#include "render_meshmod/basicalgos.h"
 #include "render_basics/api.h"
 #include "render_basics/buffer.h"
 #include "al2o3_cadt/vector.h"
 #include "al2o3_cmath/vector.hpp"
 #include "meshrenderable.hpp"
+#include "manager.hpp"
+#include "cache.hpp"
+#include "bvh.hpp"
 
 static uint32_t PickVisibleColour(uint32_t primitiveId) {
 #define MU_PACKCOLOUR(r, g, b, a) (((uint32_t)r) << 0) | ((g) << 8) | ((b) << 16) | ((a) << 24)
@@ -40,312 +42,581 @@ static uint32_t PickVisibleColour(uint32_t primitiveId) {
 	return ColourTable[primitiveId];
 }
 
-void VertexPosNormal::UpdateIfNeeded(MeshMod_MeshRenderable* mr) {
-	ASSERT(MeshMod_MeshHandleIsValid(mr->MMMesh));
+namespace {
 
-	using namespace Math;
+void EnsureGpuVertexBuffer(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr, uint32_t vertexCount, uint32_t vertexSize) {
+	Render_BufferHandle& gpuVertexBuffer = manager->draws.vertexBuffer[mr->drawIndex];
+	if (vertexCount > mr->gpuVertexBufferCapacity) {
+		MeshModRender_ReleaseBuffer(manager, gpuVertexBuffer);
 
-	uint64_t const actualPosHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexPositionTag);
-	uint64_t const actualNormalHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexNormalTag);
+		Render_BufferVertexDesc const vbDesc{
+				vertexCount,
+				vertexSize,
+				false
+		};
+		gpuVertexBuffer = Render_BufferCreateVertex(mr->renderer, &vbDesc);
+		mr->gpuVertexBufferCapacity = vertexCount;
+	}
+	manager->draws.vertexCount[mr->drawIndex] = vertexCount;
+}
 
-	if(mr->storedPosHash != actualPosHash || mr->storedNormalHash != actualNormalHash) {
-		// has changed position or normal so regenerate
-		mr->storedPosHash = actualPosHash;
-		mr->storedNormalHash = actualNormalHash;
-
-		// if we need to triangulate clone to not change the original mesh
-		bool const isTriangleBRepOnly = (!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonQuadBRepTag)) &&
-				(!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonConvexBRepTag));
-		MeshMod_MeshHandle clone;
-		if (isTriangleBRepOnly) {
-			clone = mr->MMMesh;
+// Vertices are generated into a fixed size chunk and uploaded a chunk at a time,
+// so generation and upload are interleaved and the cpu side never holds more than
+// a chunk of the output. If a retained cpu copy is wanted the chunks are written
+// straight into that instead of the chunk memory. Given a cache, chunks are
+// written to it as they are uploaded
+template<typename Vertex>
+struct StreamSink {
+	StreamSink(MeshModRender_Pool& pool, MeshModRender_Cache* cache, MeshModRender_CacheKey const& cacheKey, void* chunkMemory, MeshModRender_PoolArray* retained) :
+			pool(pool),
+			cache(cache),
+			cacheKey(cacheKey),
+			writeCache(false),
+			chunkMemory(chunkMemory),
+			retained(retained),
+			chunkVertexCount(MeshModRender_StreamChunkSize / sizeof(Vertex)),
+			base(0),
+			count(0) {
+	}
+
+	void Start(Render_BufferHandle buffer, uint32_t vertexCount) {
+		gpuVertexBuffer = buffer;
+		writeCache = cache && MeshModRender_CacheBeginWrite(cache, cacheKey, vertexCount, cacheWriter);
+
+		if (retained && !MeshModRender_PoolArrayResize(pool, *retained, sizeof(Vertex), vertexCount)) {
+			LOGWARNING("MeshModRender out of memory retaining cpu vertices");
+			retained = nullptr;
+		}
+		if (retained) {
+			chunk = (Vertex*) retained->data;
 		} else {
-			clone = MeshMod_MeshClone(mr->MMMesh);
-			MeshMod_MeshTrianglate(clone);
+			chunk = (Vertex*) chunkMemory;
 		}
+	}
 
-		// TODO compacted fast path for meshmod...
+	Vertex& Next() {
+		if (count == chunkVertexCount) {
+			Flush();
+		}
+		return retained ? chunk[base + count++] : chunk[count++];
+	}
 
-		// clear old data
-		CADT_VectorResize(mr->cpuVertexBuffer, 0);
+	void Flush() {
+		if (count == 0) {
+			return;
+		}
+		Render_BufferUpdateDesc vertexUpdate = {
+				retained ? chunk + base : chunk,
+				sizeof(Vertex) * base,
+				sizeof(Vertex) * count
+		};
+		Render_BufferUpload(gpuVertexBuffer, &vertexUpdate);
+		if (writeCache) {
+			MeshModRender_CacheWrite(cacheWriter, vertexUpdate.data, vertexUpdate.size);
+		}
+		base += count;
+		count = 0;
+	}
 
-		MeshMod_PolygonHandle phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, NULL);
-		while (MeshMod_MeshPolygonIsValid(clone, phandle)) {
-			auto tri = MeshMod_MeshPolygonTriBRepTagHandleToPtr(clone, phandle, 0);
+	void Finish(Math_Vec3F const& boundsMin, Math_Vec3F const& boundsMax) {
+		Flush();
+		if (writeCache) {
+			MeshModRender_CacheEndWrite(cache, cacheWriter, boundsMin, boundsMax);
+		}
+	}
 
-			for (int i = 0; i < 3; ++i) {
-				VertexPosNormal vert;
-				MeshMod_VertexHandle vh = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(clone, tri->edge[i], 0)->vertex;
-				memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(clone, vh, 0), sizeof(Vec3F));
-				memcpy(&vert.normal, MeshMod_MeshVertexNormalTagHandleToPtr(clone, vh, 0), sizeof(Vec3F));
-				CADT_VectorPushElement(mr->cpuVertexBuffer, &vert);
-			}
+	MeshModRender_Pool& pool;
+	MeshModRender_Cache* cache;
+	MeshModRender_CacheKey const cacheKey;
+	MeshModRender_CacheWriter cacheWriter;
+	bool writeCache;
+	void* chunkMemory;
+	MeshModRender_PoolArray* retained;
+	Render_BufferHandle gpuVertexBuffer;
+	Vertex* chunk;
+	uint32_t const chunkVertexCount;
+	uint32_t base;
+	uint32_t count;
+};
+
+// streams into the renderables own vertex buffer using the managers chunk, render thread only
+template<typename Vertex>
+struct RenderableSink : StreamSink<Vertex> {
+	RenderableSink(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr, MeshModRender_Cache* writeCache, MeshModRender_CacheKey const& cacheKey) :
+			StreamSink<Vertex>(manager->pool, writeCache, cacheKey, manager->streamChunk, mr->retainCpuCopy ? &mr->cpuVertexBuffer : nullptr),
+			manager(manager),
+			mr(mr) {
+	}
 
-			phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, &phandle);
-		}
+	void Begin(uint32_t vertexCount) {
+		EnsureGpuVertexBuffer(manager, mr, vertexCount, sizeof(Vertex));
+		this->Start(manager->draws.vertexBuffer[mr->drawIndex], vertexCount);
+	}
+
+	void End(Math_Vec3F const& boundsMin, Math_Vec3F const& boundsMax) {
+		this->Finish(boundsMin, boundsMax);
+		manager->draws.localBoundsMin[mr->drawIndex] = boundsMin;
+		manager->draws.localBoundsMax[mr->drawIndex] = boundsMax;
+	}
 
-		uint32_t const vertexCount = (uint32_t) CADT_VectorSize(mr->cpuVertexBuffer);
-		if(vertexCount > mr->gpuVertexBufferCount) {
-			Render_BufferDestroy(mr->renderer, mr->gpuVertexBuffer);
+	MeshModRender_Manager* manager;
+	MeshMod_MeshRenderable* mr;
+};
+
+// async builds stream into a new vertex buffer from the worker using the builds own
+// chunk (render_basics buffer creation and uploads are thread safe), so swapping
+// the result in on the render thread is just a handle swap
+template<typename Vertex>
+struct BuildSink : StreamSink<Vertex> {
+	BuildSink(MeshModRender_AsyncBuild* build, MeshModRender_CacheKey const& cacheKey) :
+			StreamSink<Vertex>(build->manager->pool, build->writeCache ? build->manager->cache : nullptr, cacheKey, build->chunk, build->retainCpuCopy ? &build->vertices : nullptr),
+			build(build) {
+	}
 
-			Render_BufferVertexDesc const ibDesc {
+	void Begin(uint32_t vertexCount) {
+		build->vertexCount = vertexCount;
+		if (vertexCount) {
+			Render_BufferVertexDesc const vbDesc{
 					vertexCount,
-					sizeof(VertexPosNormal),
+					sizeof(Vertex),
 					false
 			};
-			mr->gpuVertexBuffer = Render_BufferCreateVertex(mr->renderer, &ibDesc);
-			mr->gpuVertexBufferCount = vertexCount;
+			build->vertexBuffer = Render_BufferCreateVertex(build->manager->renderer, &vbDesc);
 		}
+		this->Start(build->vertexBuffer, vertexCount);
+	}
 
-		if(vertexCount) {
-			// upload the instance data
-			Render_BufferUpdateDesc instanceUpdate = {
-					CADT_VectorData(mr->cpuVertexBuffer),
-					0,
-					sizeof(VertexPosNormal) * vertexCount
-			};
-			Render_BufferUpload(mr->gpuVertexBuffer, &instanceUpdate);
-		}
+	void End(Math_Vec3F const& boundsMin, Math_Vec3F const& boundsMax) {
+		this->Finish(boundsMin, boundsMax);
+		build->boundsMin = boundsMin;
+		build->boundsMax = boundsMax;
+	}
 
-		if (!isTriangleBRepOnly) {
-			MeshMod_MeshDestroy(clone);
-		}
+	MeshModRender_AsyncBuild* build;
+};
+
+// where pick data is captured to, the arrays are resized to fit
+struct PickTarget {
+	MeshModRender_Pool& pool;
+	MeshModRender_PoolArray& positions;
+	MeshModRender_PoolArray& polygons;
+	MeshModRender_PoolArray& polygonIds;
+
+	bool hasPolygonIds;
+	// FNV-1a of the polygon handles, decides between a bvh refit and rebuild
+	uint64_t topologyHash;
+};
+
+// a triangle of the fan triangulated source mesh
+struct FanTriangle {
+	MeshMod_VertexHandle vertex[3];
+	MeshMod_PolygonHandle polygon;
+	// the polygons id tag if it has one else the triangle index
+	uint32_t polygonId;
+};
+
+// convex is the most general so wins if a mesh somehow has more than one brep
+MeshMod_Tag PolygonBRepTag(MeshMod_MeshHandle mesh) {
+	if (MeshMod_MeshPolygonTagExists(mesh, MeshMod_PolygonConvexBRepTag)) {
+		return MeshMod_PolygonConvexBRepTag;
 	}
+	if (MeshMod_MeshPolygonTagExists(mesh, MeshMod_PolygonQuadBRepTag)) {
+		return MeshMod_PolygonQuadBRepTag;
+	}
+	return MeshMod_PolygonTriBRepTag;
 }
 
-void VertexPosColour::UpdateIfNeededTriColours(MeshMod_MeshRenderable *mr){
-	ASSERT(MeshMod_MeshHandleIsValid(mr->MMMesh));
+// convex polygons end at the first invalid edge
+uint32_t PolygonEdges(MeshMod_MeshHandle mesh, MeshMod_Tag brepTag, MeshMod_PolygonHandle phandle, MeshMod_EdgeHandle const*& edges) {
+	if (brepTag == MeshMod_PolygonTriBRepTag) {
+		edges = MeshMod_MeshPolygonTriBRepTagHandleToPtr(mesh, phandle, 0)->edge;
+		return 3;
+	}
+	if (brepTag == MeshMod_PolygonQuadBRepTag) {
+		edges = MeshMod_MeshPolygonQuadBRepTagHandleToPtr(mesh, phandle, 0)->edge;
+		return 4;
+	}
+	edges = MeshMod_MeshPolygonConvexBRepTagHandleToPtr(mesh, phandle, 0)->edge;
+	uint32_t count = 0;
+	while (count < MeshMod_PolygonConvexMaxEdges && MeshMod_MeshEdgeIsValid(mesh, edges[count])) {
+		count++;
+	}
+	return count;
+}
 
-	using namespace Math;
+// every brep MeshMod has is convex so a fan from each polygons first vertex
+// triangulates it without modifying (or cloning) the mesh. allocTriangles(count)
+// returns the output, false if it couldn't
+template<typename Alloc>
+bool FanTriangulate(MeshMod_MeshHandle mesh, Alloc allocTriangles, FanTriangle*& triangles, uint32_t& triangleCount) {
+	MeshMod_Tag const brepTag = PolygonBRepTag(mesh);
+	MeshMod_EdgeHandle const* edges;
+
+	// count first so the output can be sized before anything is written
+	triangleCount = 0;
+	MeshMod_PolygonHandle phandle = MeshMod_MeshPolygonTagIterate(mesh, brepTag, NULL);
+	while (MeshMod_MeshPolygonIsValid(mesh, phandle)) {
+		uint32_t const edgeCount = PolygonEdges(mesh, brepTag, phandle, edges);
+		triangleCount += edgeCount > 2 ? edgeCount - 2 : 0;
+		phandle = MeshMod_MeshPolygonTagIterate(mesh, brepTag, &phandle);
+	}
 
-	uint64_t const actualPosHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexPositionTag);
+	triangles = allocTriangles(triangleCount);
+	if (triangleCount && !triangles) {
+		return false;
+	}
 
-	if(mr->storedPosHash != actualPosHash) {
-		// has changed position or normal so regenerate
-		mr->storedPosHash = actualPosHash;
-
-		// if we need to triangulate clone to not change the original mesh
-		bool const isTriangleBRepOnly = (!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonQuadBRepTag)) &&
-				(!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonConvexBRepTag));
-		MeshMod_MeshHandle clone = {0};
-		if (isTriangleBRepOnly) {
-			clone = mr->MMMesh;
-		} else {
-			clone = MeshMod_MeshClone(mr->MMMesh);
-			MeshMod_MeshTrianglate(clone);
+	bool const hasPolygonId = MeshMod_MeshPolygonTagExists(mesh, MeshMod_PolygonIdTag);
+	uint32_t triangle = 0;
+	phandle = MeshMod_MeshPolygonTagIterate(mesh, brepTag, NULL);
+	while (MeshMod_MeshPolygonIsValid(mesh, phandle)) {
+		uint32_t const edgeCount = PolygonEdges(mesh, brepTag, phandle, edges);
+		uint32_t const polygonId = hasPolygonId ? *MeshMod_MeshPolygonU32TagHandleToPtr(mesh, phandle, MeshMod_PolygonIdUserTag) : 0;
+		for (uint32_t i = 2; i < edgeCount; ++i) {
+			FanTriangle& tri = triangles[triangle];
+			tri.vertex[0] = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(mesh, edges[0], 0)->vertex;
+			tri.vertex[1] = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(mesh, edges[i - 1], 0)->vertex;
+			tri.vertex[2] = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(mesh, edges[i], 0)->vertex;
+			tri.polygon = phandle;
+			tri.polygonId = hasPolygonId ? polygonId : triangle;
+			triangle++;
 		}
+		phandle = MeshMod_MeshPolygonTagIterate(mesh, brepTag, &phandle);
+	}
+	return true;
+}
 
-		// TODO compacted fast path for meshmod...
-
-		// clear old data
-		CADT_VectorResize(mr->cpuVertexBuffer, 0);
-
-		uint32_t primitiveId = 0;
-		MeshMod_PolygonHandle phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, NULL);
-		while (MeshMod_MeshPolygonIsValid(clone, phandle)) {
-			auto tri = MeshMod_MeshPolygonTriBRepTagHandleToPtr(clone, phandle, 0);
-
-			for (int i = 0; i < 3; ++i) {
-				VertexPosColour vert;
-				MeshMod_VertexHandle vh = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(clone, tri->edge[i], 0)->vertex;
-				memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(clone, vh, 0), sizeof(Vec3F));
-				vert.colour = PickVisibleColour(primitiveId);
-				CADT_VectorPushElement(mr->cpuVertexBuffer, &vert);
-			}
+// fan triangulates mesh through allocTriangles and writes 3 vertices per
+// triangle into the sink
+template<typename Vertex, typename Sink, typename Generator, typename Alloc>
+void GenerateVertices(MeshMod_MeshHandle mesh, Alloc allocTriangles, bool usePolygonId, PickTarget* pick, Sink& sink, Generator generator) {
+	// TODO compacted fast path for meshmod...
+
+	FanTriangle* triangles;
+	uint32_t triangleCount;
+	if (!FanTriangulate(mesh, allocTriangles, triangles, triangleCount)) {
+		LOGERROR("MeshModRender out of memory triangulating mesh");
+		return;
+	}
 
-			phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, &phandle);
-			primitiveId++;
+	uint32_t const vertexCount = triangleCount * 3;
+	sink.Begin(vertexCount);
+
+	Math_Vec3F boundsMin = {0, 0, 0};
+	Math_Vec3F boundsMax = {0, 0, 0};
+
+	Math_Vec3F* pickPositions = nullptr;
+	MeshMod_PolygonHandle* pickPolygons = nullptr;
+	uint32_t* pickPolygonIds = nullptr;
+	if (pick) {
+		if (MeshModRender_PoolArrayResize(pick->pool, pick->positions, sizeof(Math_Vec3F), vertexCount) &&
+				MeshModRender_PoolArrayResize(pick->pool, pick->polygons, sizeof(MeshMod_PolygonHandle), triangleCount) &&
+				MeshModRender_PoolArrayResize(pick->pool, pick->polygonIds, sizeof(uint32_t), triangleCount)) {
+			pickPositions = (Math_Vec3F*) pick->positions.data;
+			pickPolygons = (MeshMod_PolygonHandle*) pick->polygons.data;
+			pickPolygonIds = (uint32_t*) pick->polygonIds.data;
+		} else {
+			// left empty so picks just miss
+			LOGWARNING("MeshModRender out of memory capturing pick data");
+			MeshModRender_PoolArrayFree(pick->pool, pick->positions);
+			MeshModRender_PoolArrayFree(pick->pool, pick->polygons);
+			MeshModRender_PoolArrayFree(pick->pool, pick->polygonIds);
 		}
+		pick->hasPolygonIds = MeshMod_MeshPolygonTagExists(mesh, MeshMod_PolygonIdTag);
+		pick->topologyHash = 14695981039346656037ull;
+	}
 
-		uint32_t const vertexCount = (uint32_t) CADT_VectorSize(mr->cpuVertexBuffer);
-		if(vertexCount > mr->gpuVertexBufferCount) {
-			Render_BufferDestroy(mr->renderer, mr->gpuVertexBuffer);
-
-			Render_BufferVertexDesc const vbDesc {
-					vertexCount,
-					sizeof(VertexPosColour),
-					false
-			};
-			mr->gpuVertexBuffer = Render_BufferCreateVertex(mr->renderer, &vbDesc);
-			mr->gpuVertexBufferCount = vertexCount;
+	bool firstVertex = true;
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		FanTriangle const& tri = triangles[t];
+		// the polygon id falls back to the triangle index without a tag
+		uint32_t const primitiveId = usePolygonId ? tri.polygonId : t;
+
+		if (pickPolygons) {
+			*pickPolygons++ = tri.polygon;
+			*pickPolygonIds++ = tri.polygonId;
+			uint8_t const* bytes = (uint8_t const*) &tri.polygon;
+			for (size_t b = 0; b < sizeof(tri.polygon); ++b) {
+				pick->topologyHash = (pick->topologyHash ^ bytes[b]) * 1099511628211ull;
+			}
 		}
 
-		if(vertexCount) {
-			// upload the vertex data
-			Render_BufferUpdateDesc instanceUpdate = {
-					CADT_VectorData(mr->cpuVertexBuffer),
-					0,
-					sizeof(VertexPosColour) * vertexCount
-			};
-			Render_BufferUpload(mr->gpuVertexBuffer, &instanceUpdate);
-		}
+		for (int i = 0; i < 3; ++i) {
+			Vertex& vert = sink.Next();
+			generator(mesh, tri.vertex[i], primitiveId, vert);
+			if (pickPositions) {
+				*pickPositions++ = vert.position;
+			}
 
-		if (!isTriangleBRepOnly) {
-			MeshMod_MeshDestroy(clone);
+			if (firstVertex) {
+				boundsMin = vert.position;
+				boundsMax = vert.position;
+				firstVertex = false;
+			} else {
+				boundsMin.x = vert.position.x < boundsMin.x ? vert.position.x : boundsMin.x;
+				boundsMin.y = vert.position.y < boundsMin.y ? vert.position.y : boundsMin.y;
+				boundsMin.z = vert.position.z < boundsMin.z ? vert.position.z : boundsMin.z;
+				boundsMax.x = vert.position.x > boundsMax.x ? vert.position.x : boundsMax.x;
+				boundsMax.y = vert.position.y > boundsMax.y ? vert.position.y : boundsMax.y;
+				boundsMax.z = vert.position.z > boundsMax.z ? vert.position.z : boundsMax.z;
+			}
 		}
 	}
-}
-
-void VertexPosColour::UpdateIfNeededFaceColours(MeshMod_MeshRenderable *mr){
-	ASSERT(MeshMod_MeshHandleIsValid(mr->MMMesh));
 
-	using namespace Math;
+	sink.End(boundsMin, boundsMax);
+}
 
-	uint64_t const actualPosHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexPositionTag);
-	uint64_t const actualNormalHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexNormalTag);
+// a hit uploads straight from the mapped file pages, no generation at all
+bool UploadFromCache(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr, MeshModRender_CacheKey const& key) {
+	MeshModRender_CacheMapping mapping;
+	if (!MeshModRender_CacheLookup(manager->cache, key, mapping)) {
+		return false;
+	}
 
-	if(mr->storedPosHash != actualPosHash || mr->storedNormalHash != actualNormalHash) {
-		// has changed position or normal so regenerate
-		mr->storedPosHash = actualPosHash;
-		mr->storedNormalHash = actualNormalHash;
-
-		// if we need to triangulate clone to not change the original mesh
-		bool const isTriangleBRepOnly = (!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonQuadBRepTag)) &&
-				(!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonConvexBRepTag));
-		MeshMod_MeshHandle clone = {0};
-		if (isTriangleBRepOnly) {
-			clone = mr->MMMesh;
+	EnsureGpuVertexBuffer(manager, mr, mapping.vertexCount, key.vertexSize);
+	size_t const size = (size_t) mapping.vertexCount * key.vertexSize;
+	if (size) {
+		Render_BufferUpdateDesc vertexUpdate = {
+				mapping.vertices,
+				0,
+				size
+		};
+		Render_BufferUpload(manager->draws.vertexBuffer[mr->drawIndex], &vertexUpdate);
+	}
+	if (mr->retainCpuCopy) {
+		if (MeshModRender_PoolArrayResize(manager->pool, mr->cpuVertexBuffer, key.vertexSize, mapping.vertexCount)) {
+			memcpy(mr->cpuVertexBuffer.data, mapping.vertices, size);
 		} else {
-			clone = MeshMod_MeshClone(mr->MMMesh);
-			MeshMod_MeshTrianglate(clone);
+			LOGWARNING("MeshModRender out of memory retaining cpu vertices");
 		}
+	}
 
-		// TODO compacted fast path for meshmod...
-
-		// clear old data
-		CADT_VectorResize(mr->cpuVertexBuffer, 0);
-
-		bool const hasPolygonId = MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonIdTag);
-
-		uint32_t primitiveId = 0;
-		MeshMod_PolygonHandle phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, NULL);
-		while (MeshMod_MeshPolygonIsValid(clone, phandle)) {
-			auto tri = MeshMod_MeshPolygonTriBRepTagHandleToPtr(clone, phandle, 0);
+	manager->draws.localBoundsMin[mr->drawIndex] = mapping.boundsMin;
+	manager->draws.localBoundsMax[mr->drawIndex] = mapping.boundsMax;
 
-			if(hasPolygonId) {
-				primitiveId = *MeshMod_MeshPolygonU32TagHandleToPtr(clone, phandle, MeshMod_PolygonIdUserTag);
-			}
+	MeshModRender_CacheReleaseMapping(mapping);
+	return true;
+}
 
-			for (int i = 0; i < 3; ++i) {
-				VertexPosColour vert;
-				MeshMod_VertexHandle vh = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(clone, tri->edge[i], 0)->vertex;
-				memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(clone, vh, 0), sizeof(Vec3F));
-				vert.colour = PickVisibleColour(primitiveId);
-				CADT_VectorPushElement(mr->cpuVertexBuffer, &vert);
-			}
+template<typename Vertex, typename Generator>
+void StreamVertices(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr, bool usePolygonId, Generator generator) {
+	MeshModRender_CacheKey const cacheKey = {
+			mr->storedPosHash,
+			mr->storedNormalHash,
+			mr->storedTopologyHash,
+			(uint32_t) manager->draws.renderStyle[mr->drawIndex],
+			sizeof(Vertex)
+	};
+	// cache entries have no polygon data so pickable meshes always build
+	if (manager->cache && !mr->pickable && UploadFromCache(manager, mr, cacheKey)) {
+		return;
+	}
 
-			phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, &phandle);
+	MeshModRender_Cache* const writeCache = mr->cacheWritten ? nullptr : manager->cache;
+	mr->cacheWritten = true;
+	RenderableSink<Vertex> sink(manager, mr, writeCache, cacheKey);
+	PickTarget pick = {
+			manager->pool,
+			mr->pickPositions,
+			mr->pickPolygons,
+			mr->pickPolygonIds,
+			false,
+			0
+	};
+	// the triangulation is only needed while generating, render thread so scratch
+	MeshModRender_ScratchMark const mark = MeshModRender_ScratchGetMark(manager->scratch);
+	auto allocTriangles = [manager](uint32_t count) {
+		return (FanTriangle*) MeshModRender_ScratchAlloc(manager->scratch, sizeof(FanTriangle) * count);
+	};
+	GenerateVertices<Vertex>(mr->MMMesh, allocTriangles, usePolygonId, mr->pickable ? &pick : nullptr, sink, generator);
+	MeshModRender_ScratchRewind(manager->scratch, mark);
 
-			primitiveId++;
-		}
+	if (mr->pickable) {
+		mr->pickHasPolygonIds = pick.hasPolygonIds;
+		MeshModRender_PickDataBuilt(manager, mr, pick.topologyHash);
+	}
+}
 
-		uint32_t const vertexCount = (uint32_t) CADT_VectorSize(mr->cpuVertexBuffer);
-		if(vertexCount > mr->gpuVertexBufferCount) {
-			Render_BufferDestroy(mr->renderer, mr->gpuVertexBuffer);
+template<typename Vertex, typename Generator>
+void BuildVertices(MeshModRender_AsyncBuild* build, bool usePolygonId, Generator generator) {
+	MeshModRender_Manager* manager = build->manager;
 
-			Render_BufferVertexDesc const vbDesc {
-					vertexCount,
-					sizeof(VertexPosColour),
+	MeshModRender_CacheKey const cacheKey = {
+			build->posHash,
+			build->normalHash,
+			build->topologyHash,
+			(uint32_t) build->style,
+			sizeof(Vertex)
+	};
+	MeshModRender_CacheMapping mapping;
+	if (manager->cache && !build->pickable && MeshModRender_CacheLookup(manager->cache, cacheKey, mapping)) {
+		// uploaded straight from the mapped file pages like a sync hit
+		build->vertexCount = mapping.vertexCount;
+		size_t const size = (size_t) mapping.vertexCount * sizeof(Vertex);
+		if (size) {
+			Render_BufferVertexDesc const vbDesc{
+					mapping.vertexCount,
+					sizeof(Vertex),
 					false
 			};
-			mr->gpuVertexBuffer = Render_BufferCreateVertex(mr->renderer, &vbDesc);
-			mr->gpuVertexBufferCount = vertexCount;
-		}
-
-		if(vertexCount) {
-			// upload the vertex data
-			Render_BufferUpdateDesc instanceUpdate = {
-					CADT_VectorData(mr->cpuVertexBuffer),
+			build->vertexBuffer = Render_BufferCreateVertex(manager->renderer, &vbDesc);
+			Render_BufferUpdateDesc vertexUpdate = {
+					mapping.vertices,
 					0,
-					sizeof(VertexPosColour) * vertexCount
+					size
 			};
-			Render_BufferUpload(mr->gpuVertexBuffer, &instanceUpdate);
+			Render_BufferUpload(build->vertexBuffer, &vertexUpdate);
 		}
+		if (build->retainCpuCopy) {
+			if (MeshModRender_PoolArrayResize(manager->pool, build->vertices, sizeof(Vertex), mapping.vertexCount)) {
+				memcpy(build->vertices.data, mapping.vertices, size);
+			} else {
+				LOGWARNING("MeshModRender out of memory retaining cpu vertices");
+			}
+		}
+		build->boundsMin = mapping.boundsMin;
+		build->boundsMax = mapping.boundsMax;
+		MeshModRender_CacheReleaseMapping(mapping);
+		return;
+	}
 
-		if (!isTriangleBRepOnly) {
-			MeshMod_MeshDestroy(clone);
+	BuildSink<Vertex> sink(build, cacheKey);
+	PickTarget pick = {
+			manager->pool,
+			build->pickPositions,
+			build->pickPolygons,
+			build->pickPolygonIds,
+			false,
+			0
+	};
+	// scratch is render thread only, recycled builds keep their triangle array instead
+	auto allocTriangles = [build](uint32_t count) {
+		return MeshModRender_PoolArrayResize(build->manager->pool, build->triangles, sizeof(FanTriangle), count) ?
+				(FanTriangle*) build->triangles.data : nullptr;
+	};
+	GenerateVertices<Vertex>(build->snapshot, allocTriangles, usePolygonId, build->pickable ? &pick : nullptr, sink, generator);
+
+	if (build->pickable) {
+		build->pickHasPolygonIds = pick.hasPolygonIds;
+		build->pickTopologyHash = pick.topologyHash;
+		// refit the copy of the live bvh like a sync update would refit the live one
+		auto positions = (Math_Vec3F const*) build->pickPositions.data;
+		uint32_t const triangleCount = build->pickPolygons.count;
+		if (pick.topologyHash != build->refitTopologyHash ||
+				!MeshModRender_BvhRefit(build->bvh, positions, triangleCount)) {
+			MeshModRender_BvhDestroy(build->bvh);
+			build->bvh = MeshModRender_BvhCreate(manager->workers, &manager->pool, positions, triangleCount);
 		}
 	}
+
 }
 
-void VertexPosNormalColour::UpdateIfNeeded(MeshMod_MeshRenderable* mr) {
-	ASSERT(MeshMod_MeshHandleIsValid(mr->MMMesh));
+void GeneratePosNormal(MeshMod_MeshHandle mesh, MeshMod_VertexHandle vh, uint32_t, VertexPosNormal& vert) {
+	memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(mesh, vh, 0), sizeof(Math_Vec3F));
+	memcpy(&vert.normal, MeshMod_MeshVertexNormalTagHandleToPtr(mesh, vh, 0), sizeof(Math_Vec3F));
+}
 
-	using namespace Math;
+void GeneratePosColour(MeshMod_MeshHandle mesh, MeshMod_VertexHandle vh, uint32_t primitiveId, VertexPosColour& vert) {
+	memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(mesh, vh, 0), sizeof(Math_Vec3F));
+	vert.colour = PickVisibleColour(primitiveId);
+}
 
-	uint64_t const actualPosHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexPositionTag);
-	uint64_t const actualNormalHash = MeshMod_MeshVertexTagGetOrComputeHash(mr->MMMesh, MeshMod_VertexNormalTag);
+void GeneratePosNormalColour(MeshMod_MeshHandle mesh, MeshMod_VertexHandle vh, uint32_t primitiveId, VertexPosNormalColour& vert) {
+	memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(mesh, vh, 0), sizeof(Math_Vec3F));
+	memcpy(&vert.normal, MeshMod_MeshVertexNormalTagHandleToPtr(mesh, vh, 0), sizeof(Math_Vec3F));
+	vert.colour = PickVisibleColour(primitiveId);
+}
 
-	if(mr->storedPosHash != actualPosHash || mr->storedNormalHash != actualNormalHash) {
-		// has changed position or normal so regenerate
-		mr->storedPosHash = actualPosHash;
-		mr->storedNormalHash = actualNormalHash;
-
-		// if we need to triangulate clone to not change the original mesh
-		bool const isTriangleBRepOnly = (!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonQuadBRepTag)) &&
-				(!MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonConvexBRepTag));
-		MeshMod_MeshHandle clone;
-		if (isTriangleBRepOnly) {
-			clone = mr->MMMesh;
-		} else {
-			clone = MeshMod_MeshClone(mr->MMMesh);
-			MeshMod_MeshTrianglate(clone);
-		}
+} // end anonymous namespace
 
-		// TODO compacted fast path for meshmod...
+// which polygons use which edges and vertices plus the polygon ids, each tag
+// hash is cached by MeshMod until the tag changes
+static uint64_t TopologyHash(MeshMod_MeshHandle mesh) {
+	static MeshMod_Tag const PolygonTags[] = {
+			MeshMod_PolygonTriBRepTag,
+			MeshMod_PolygonQuadBRepTag,
+			MeshMod_PolygonConvexBRepTag,
+			MeshMod_PolygonIdTag,
+	};
 
-		// clear old data
-		CADT_VectorResize(mr->cpuVertexBuffer, 0);
+	uint64_t hash = MeshMod_MeshEdgeTagGetOrComputeHash(mesh, MeshMod_EdgeHalfEdgeTag);
+	for(MeshMod_Tag const tag : PolygonTags) {
+		if(MeshMod_MeshPolygonTagExists(mesh, tag)) {
+			hash = (hash ^ MeshMod_MeshPolygonTagGetOrComputeHash(mesh, tag)) * 1099511628211ull;
+		}
+	}
+	return hash;
+}
 
-		bool const hasPolygonId = MeshMod_MeshPolygonTagExists(mr->MMMesh, MeshMod_PolygonIdTag);
-		uint32_t primitiveId = 0;
+void MeshModRender_ComputeHashes(MeshMod_MeshHandle source) {
+	MeshMod_MeshVertexTagGetOrComputeHash(source, MeshMod_VertexPositionTag);
+	MeshMod_MeshVertexTagGetOrComputeHash(source, MeshMod_VertexNormalTag);
+	TopologyHash(source);
+}
 
-		MeshMod_PolygonHandle phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, NULL);
-		while (MeshMod_MeshPolygonIsValid(clone, phandle)) {
-			auto tri = MeshMod_MeshPolygonTriBRepTagHandleToPtr(clone, phandle, 0);
+bool MeshModRender_StoreHashesIfChanged(MeshMod_MeshRenderable* mr, MeshMod_MeshHandle source, MeshModRender_RenderStyle style) {
+	ASSERT(MeshMod_MeshHandleIsValid(source));
 
-			if(hasPolygonId) {
-				primitiveId = *MeshMod_MeshPolygonU32TagHandleToPtr(clone, phandle, MeshMod_PolygonIdUserTag);
-			}
+	uint64_t const actualPosHash = MeshMod_MeshVertexTagGetOrComputeHash(source, MeshMod_VertexPositionTag);
+	// triangle colours don't use normals so don't rebuild when only they change
+	uint64_t const actualNormalHash = (style == MMR_RS_TRIANGLE_COLOURS) ? mr->storedNormalHash :
+			MeshMod_MeshVertexTagGetOrComputeHash(source, MeshMod_VertexNormalTag);
+	uint64_t const actualTopologyHash = TopologyHash(source);
 
-			for (int i = 0; i < 3; ++i) {
-				VertexPosNormalColour vert;
-				MeshMod_VertexHandle vh = MeshMod_MeshEdgeHalfEdgeTagHandleToPtr(clone, tri->edge[i], 0)->vertex;
-				memcpy(&vert.position, MeshMod_MeshVertexPositionTagHandleToPtr(clone, vh, 0), sizeof(Vec3F));
-				memcpy(&vert.normal, MeshMod_MeshVertexNormalTagHandleToPtr(clone, vh, 0), sizeof(Vec3F));
-				vert.colour = PickVisibleColour(primitiveId);
-				CADT_VectorPushElement(mr->cpuVertexBuffer, &vert);
-			}
+	if(mr->storedPosHash == actualPosHash &&
+			mr->storedNormalHash == actualNormalHash &&
+			mr->storedTopologyHash == actualTopologyHash) {
+		return false;
+	}
+	mr->storedPosHash = actualPosHash;
+	mr->storedNormalHash = actualNormalHash;
+	mr->storedTopologyHash = actualTopologyHash;
+	return true;
+}
 
-			phandle = MeshMod_MeshPolygonTagIterate(clone, MeshMod_PolygonTriBRepTag, &phandle);
-			primitiveId++;
-		}
+void MeshModRender_AsyncBuildRun(MeshModRender_AsyncBuild* build) {
+	switch(build->style) {
+		case MMR_RS_FACE_COLOURS:
+			BuildVertices<VertexPosColour>(build, true, &GeneratePosColour);
+			break;
+		case MMR_RS_TRIANGLE_COLOURS:
+			BuildVertices<VertexPosColour>(build, false, &GeneratePosColour);
+			break;
+		case MMR_RS_NORMAL:
+			BuildVertices<VertexPosNormal>(build, false, &GeneratePosNormal);
+			break;
+		case MMR_RS_DOT:
+			BuildVertices<VertexPosNormalColour>(build, true, &GeneratePosNormalColour);
+			break;
+		case MMR_MAX:
+			break;
+	}
+}
 
-		uint32_t const vertexCount = (uint32_t) CADT_VectorSize(mr->cpuVertexBuffer);
-		if(vertexCount > mr->gpuVertexBufferCount) {
-			Render_BufferDestroy(mr->renderer, mr->gpuVertexBuffer);
+void VertexPosNormal::UpdateIfNeeded(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr) {
+	if(MeshModRender_StoreHashesIfChanged(mr, mr->MMMesh, MMR_RS_NORMAL)) {
+		// has changed position or normal so regenerate
+		StreamVertices<VertexPosNormal>(manager, mr, false, &GeneratePosNormal);
+	}
+}
 
-			Render_BufferVertexDesc const ibDesc {
-					vertexCount,
-					sizeof(VertexPosNormalColour),
-					false
-			};
-			mr->gpuVertexBuffer = Render_BufferCreateVertex(mr->renderer, &ibDesc);
-			mr->gpuVertexBufferCount = vertexCount;
-		}
+void VertexPosColour::UpdateIfNeededTriColours(MeshModRender_Manager* manager, MeshMod_MeshRenderable *mr){
+	if(MeshModRender_StoreHashesIfChanged(mr, mr->MMMesh, MMR_RS_TRIANGLE_COLOURS)) {
+		// has changed position so regenerate
+		StreamVertices<VertexPosColour>(manager, mr, false, &GeneratePosColour);
+	}
+}
 
-		if(vertexCount) {
-			// upload the instance data
-			Render_BufferUpdateDesc instanceUpdate = {
-					CADT_VectorData(mr->cpuVertexBuffer),
-					0,
-					sizeof(VertexPosNormalColour) * vertexCount
-			};
-			Render_BufferUpload(mr->gpuVertexBuffer, &instanceUpdate);
-		}
+void VertexPosColour::UpdateIfNeededFaceColours(MeshModRender_Manager* manager, MeshMod_MeshRenderable *mr){
+	if(MeshModRender_StoreHashesIfChanged(mr, mr->MMMesh, MMR_RS_FACE_COLOURS)) {
+		// has changed position or normal so regenerate
+		StreamVertices<VertexPosColour>(manager, mr, true, &GeneratePosColour);
+	}
+}
 
-		if (!isTriangleBRepOnly) {
-			MeshMod_MeshDestroy(clone);
-		}
+void VertexPosNormalColour::UpdateIfNeeded(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mr) {
+	if(MeshModRender_StoreHashesIfChanged(mr, mr->MMMesh, MMR_RS_DOT)) {
+		// has changed position or normal so regenerate
+		StreamVertices<VertexPosNormalColour>(manager, mr, true, &GeneratePosNormalColour);
 	}
 }
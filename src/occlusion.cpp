@@ -0,0 +1,115 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_cadt/vector.h"
+#include "render_meshmodrender/render.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+#include "occlusionbuffer.hpp"
+
+namespace {
+
+// bounds tests per job when culling a batch on the workers
+uint32_t const TestsPerJob = 256;
+
+struct CullJob {
+	MeshModRender_Manager* manager;
+	Math_Mat4F const* localMatrices;
+	uint32_t count;
+};
+
+void CullBatchJob(void* data, uint32_t jobIndex) {
+	auto job = (CullJob const*) data;
+	MeshModRender_Manager* manager = job->manager;
+	MeshModRender_DrawData const& draws = manager->draws;
+
+	uint32_t const begin = jobIndex * TestsPerJob;
+	uint32_t const end = begin + TestsPerJob < job->count ? begin + TestsPerJob : job->count;
+	for(uint32_t i = begin; i < end; ++i) {
+		uint32_t const index = manager->batchIndices[i];
+		if(index == ~0u) {
+			continue;
+		}
+		if(!MeshModRender_OcclusionBufferTestBounds(manager->occlusion,
+				job->localMatrices[i],
+				draws.localBoundsMin[index],
+				draws.localBoundsMax[index])) {
+			manager->batchIndices[i] = ~0u;
+		}
+	}
+}
+
+} // end anonymous namespace
+
+void MeshModRender_OcclusionCullBatch(MeshModRender_Manager* manager, uint32_t count, Math_Mat4F const* localMatrices) {
+	if(!manager->occlusion) {
+		return;
+	}
+
+	CullJob job = {
+			manager,
+			localMatrices,
+			count
+	};
+	MeshModRender_WorkersParallelFor(manager->workers, (count + TestsPerJob - 1) / TestsPerJob, &CullBatchJob, &job);
+}
+
+AL2O3_EXTERN_C void MeshModRender_ManagerRenderOccluders(MeshModRender_Manager* manager,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* localMatrices) {
+	if(!manager->occlusion) {
+		manager->occlusion = MeshModRender_OcclusionBufferCreate(&manager->heap, manager->occlusionWidth, manager->occlusionHeight);
+		if(!manager->occlusion) {
+			LOGERROR("MeshModRender out of memory creating the occlusion buffer");
+			return;
+		}
+	}
+
+	Render_GpuView const& view = manager->views[0];
+	MeshModRender_OcclusionBufferBegin(manager->occlusion, view.worldToNDCMatrix, view.viewToNDCMatrix);
+
+	for(uint32_t i = 0; i < count; ++i) {
+		auto mesh = MeshModRender_LookupMesh(manager, mrhandles[i].handle);
+
+		// every vertex format starts with its position so the retained copy works as is
+		void const* positions;
+		uint32_t stride;
+		uint32_t vertexCount;
+		if(mesh->pickable && mesh->pickPositions.count) {
+			positions = mesh->pickPositions.data;
+			stride = sizeof(Math_Vec3F);
+			vertexCount = mesh->pickPositions.count;
+		} else if(mesh->retainCpuCopy && mesh->cpuVertexBuffer.count) {
+			positions = mesh->cpuVertexBuffer.data;
+			stride = mesh->cpuVertexBuffer.elementSize;
+			vertexCount = mesh->cpuVertexBuffer.count;
+		} else {
+			continue;
+		}
+
+		if(!MeshModRender_OcclusionBufferAddTriangles(manager->occlusion, localMatrices[i], positions, stride, vertexCount / 3)) {
+			LOGWARNING("MeshModRender out of memory adding occluders, the rest are skipped");
+			break;
+		}
+	}
+
+	MeshModRender_OcclusionBufferEnd(manager->occlusion, manager->workers);
+}
+
+AL2O3_EXTERN_C bool MeshModRender_MeshIsOccluded(MeshModRender_Manager* manager,
+		MeshModRender_MeshHandle mrhandle,
+		Math_Mat4F localMatrix) {
+	if(!manager->occlusion) {
+		return false;
+	}
+
+	auto mesh = MeshModRender_LookupMesh(manager, mrhandle.handle);
+	if(mesh->drawIndex == ~0u) {
+		return false;
+	}
+	MeshModRender_DrawData const& draws = manager->draws;
+	return !MeshModRender_OcclusionBufferTestBounds(manager->occlusion,
+			localMatrix,
+			draws.localBoundsMin[mesh->drawIndex],
+			draws.localBoundsMax[mesh->drawIndex]);
+}
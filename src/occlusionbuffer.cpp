@@ -0,0 +1,499 @@
+#include "al2o3_platform/platform.h"
+
+#include "occlusionbuffer.hpp"
+#include "allocators.hpp"
+#include "workers.hpp"
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MMR_OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#else
+#define MMR_OCCLUSION_SSE 0
+#endif
+
+namespace {
+
+uint32_t const BlockSize = 8;
+// screen tiles rasterised by one job each, multiples of the block size
+uint32_t const TileWidth = 64;
+uint32_t const TileHeight = 32;
+
+// a clipped triangle in pixel space with its edge functions and depth plane
+// ready to evaluate, inside is all three edges >= 0
+struct ScreenTriangle {
+	float edgeA[3];
+	float edgeB[3];
+	float edgeC[3];
+	float depthA;
+	float depthB;
+	float depthC;
+	int32_t minX;
+	int32_t minY;
+	int32_t maxX;
+	int32_t maxY;
+};
+
+struct ClipVertex {
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+// out = a * b, all row major
+void Multiply(float const* a, float const* b, float* out) {
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			out[r * 4 + c] = a[r * 4 + 0] * b[0 * 4 + c] +
+					a[r * 4 + 1] * b[1 * 4 + c] +
+					a[r * 4 + 2] * b[2 * 4 + c] +
+					a[r * 4 + 3] * b[3 * 4 + c];
+		}
+	}
+}
+
+ClipVertex Transform(float const* m, float const* p) {
+	return {
+			m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3],
+			m[4] * p[0] + m[5] * p[1] + m[6] * p[2] + m[7],
+			m[8] * p[0] + m[9] * p[1] + m[10] * p[2] + m[11],
+			m[12] * p[0] + m[13] * p[1] + m[14] * p[2] + m[15]
+	};
+}
+
+// a and b are on opposite sides of the near plane, distances to it aNear and bNear
+ClipVertex LerpToNearPlane(ClipVertex const& a, ClipVertex const& b, float aNear, float bNear) {
+	float const t = aNear / (aNear - bNear);
+	return {
+			a.x + (b.x - a.x) * t,
+			a.y + (b.y - a.y) * t,
+			a.z + (b.z - a.z) * t,
+			a.w + (b.w - a.w) * t
+	};
+}
+
+} // end anonymous namespace
+
+struct MeshModRender_OcclusionBuffer {
+	MeshModRender_Heap* heap;
+	uint32_t width;
+	uint32_t height;
+	uint32_t blocksX;
+	uint32_t blocksY;
+	uint32_t tilesX;
+	uint32_t tilesY;
+
+	// width * height, row major
+	float* depth;
+	// the furthest depth in each 8x8 block
+	float* blockMaxDepth;
+
+	// row major copy of the views world to clip matrix
+	float worldToClip[16];
+	// flips ndc z so larger is further for either depth direction
+	float depthSign;
+	// the near plane in clip space, nearZ * z + nearW * w >= 0 is in front of it.
+	// z >= 0 normally, z <= w for reversed z
+	float nearZ;
+	float nearW;
+	bool valid;
+
+	// set up since Begin, grown on demand and kept across frames
+	ScreenTriangle* triangles;
+	uint32_t triangleCount;
+	uint32_t triangleCapacity;
+};
+
+namespace {
+
+bool PushTriangle(MeshModRender_OcclusionBuffer* buffer, ClipVertex const& a, ClipVertex const& b, ClipVertex const& c) {
+	ClipVertex const* const v[3] = {&a, &b, &c};
+	float x[3];
+	float y[3];
+	float z[3];
+	for (int i = 0; i < 3; ++i) {
+		float const invW = 1.0f / v[i]->w;
+		x[i] = (v[i]->x * invW * 0.5f + 0.5f) * (float) buffer->width;
+		y[i] = (0.5f - v[i]->y * invW * 0.5f) * (float) buffer->height;
+		z[i] = v[i]->z * invW * buffer->depthSign;
+	}
+
+	// make the winding consistent so inside is always all edges positive, both
+	// faces are kept as open occluders like walls are only seen from one side
+	float const area = (x[2] - x[0]) * (y[1] - y[0]) - (y[2] - y[0]) * (x[1] - x[0]);
+	if (fabsf(area) < 1e-8f) {
+		return true;
+	}
+	if (area < 0.0f) {
+		float t = x[1]; x[1] = x[2]; x[2] = t;
+		t = y[1]; y[1] = y[2]; y[2] = t;
+		t = z[1]; z[1] = z[2]; z[2] = t;
+	}
+
+	float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+	for (int i = 1; i < 3; ++i) {
+		minX = x[i] < minX ? x[i] : minX;
+		maxX = x[i] > maxX ? x[i] : maxX;
+		minY = y[i] < minY ? y[i] : minY;
+		maxY = y[i] > maxY ? y[i] : maxY;
+	}
+	if (maxX <= 0.0f || maxY <= 0.0f || minX >= (float) buffer->width || minY >= (float) buffer->height) {
+		return true;
+	}
+
+	if (buffer->triangleCount == buffer->triangleCapacity) {
+		uint32_t const capacity = buffer->triangleCapacity ? buffer->triangleCapacity * 2 : 1024;
+		auto triangles = (ScreenTriangle*) MeshModRender_HeapRealloc(*buffer->heap, buffer->triangles, capacity * sizeof(ScreenTriangle));
+		if (!triangles) {
+			return false;
+		}
+		buffer->triangles = triangles;
+		buffer->triangleCapacity = capacity;
+	}
+	ScreenTriangle& tri = buffer->triangles[buffer->triangleCount++];
+
+	for (int i = 0; i < 3; ++i) {
+		int const j = (i + 1) % 3;
+		tri.edgeA[i] = y[j] - y[i];
+		tri.edgeB[i] = x[i] - x[j];
+		tri.edgeC[i] = -x[i] * tri.edgeA[i] - y[i] * tri.edgeB[i];
+	}
+
+	float const det = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	tri.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / det;
+	tri.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / det;
+	tri.depthC = z[0] - tri.depthA * x[0] - tri.depthB * y[0];
+
+	// pixel centres are sampled so these bounds are inclusive of any pixel touched
+	tri.minX = minX > 0.0f ? (int32_t) minX : 0;
+	tri.minY = minY > 0.0f ? (int32_t) minY : 0;
+	tri.maxX = maxX < (float) buffer->width ? (int32_t) ceilf(maxX) : (int32_t) buffer->width;
+	tri.maxY = maxY < (float) buffer->height ? (int32_t) ceilf(maxY) : (int32_t) buffer->height;
+	return true;
+}
+
+void RasteriseTriangle(MeshModRender_OcclusionBuffer* buffer,
+		ScreenTriangle const& tri,
+		int32_t tileX0,
+		int32_t tileY0,
+		int32_t tileX1,
+		int32_t tileY1) {
+	int32_t const x0 = (tri.minX > tileX0 ? tri.minX : tileX0) & ~3;
+	int32_t const y0 = tri.minY > tileY0 ? tri.minY : tileY0;
+	int32_t const x1 = tri.maxX < tileX1 ? tri.maxX : tileX1;
+	int32_t const y1 = tri.maxY < tileY1 ? tri.maxY : tileY1;
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	// 4 pixels a step, the tile width is a multiple of 4 so the last step never
+	// leaves the tile and pixels past the triangle bounds fail the edge tests
+#if MMR_OCCLUSION_SSE
+	__m128 const laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const edgeA0 = _mm_set1_ps(tri.edgeA[0]);
+	__m128 const edgeA1 = _mm_set1_ps(tri.edgeA[1]);
+	__m128 const edgeA2 = _mm_set1_ps(tri.edgeA[2]);
+	__m128 const depthA = _mm_set1_ps(tri.depthA);
+	for (int32_t y = y0; y < y1; ++y) {
+		float const cy = (float) y + 0.5f;
+		__m128 const rowE0 = _mm_set1_ps(tri.edgeB[0] * cy + tri.edgeC[0]);
+		__m128 const rowE1 = _mm_set1_ps(tri.edgeB[1] * cy + tri.edgeC[1]);
+		__m128 const rowE2 = _mm_set1_ps(tri.edgeB[2] * cy + tri.edgeC[2]);
+		__m128 const rowDepth = _mm_set1_ps(tri.depthB * cy + tri.depthC);
+		float* row = buffer->depth + (size_t) y * buffer->width;
+		for (int32_t x = x0; x < x1; x += 4) {
+			__m128 const px = _mm_add_ps(_mm_set1_ps((float) x), laneOffsets);
+			__m128 const e0 = _mm_add_ps(_mm_mul_ps(edgeA0, px), rowE0);
+			__m128 const e1 = _mm_add_ps(_mm_mul_ps(edgeA1, px), rowE1);
+			__m128 const e2 = _mm_add_ps(_mm_mul_ps(edgeA2, px), rowE2);
+			__m128 const inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if (_mm_movemask_ps(inside) == 0) {
+				continue;
+			}
+			__m128 const depth = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+			__m128 const old = _mm_load_ps(row + x);
+			__m128 const nearer = _mm_min_ps(old, depth);
+			_mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+		}
+	}
+#else
+	for (int32_t y = y0; y < y1; ++y) {
+		float const cy = (float) y + 0.5f;
+		float* row = buffer->depth + (size_t) y * buffer->width;
+		for (int32_t x = x0; x < x1; ++x) {
+			float const cx = (float) x + 0.5f;
+			bool inside = true;
+			for (int i = 0; i < 3; ++i) {
+				inside = inside && (tri.edgeA[i] * cx + tri.edgeB[i] * cy + tri.edgeC[i]) >= 0.0f;
+			}
+			if (inside) {
+				float const depth = tri.depthA * cx + tri.depthB * cy + tri.depthC;
+				row[x] = depth < row[x] ? depth : row[x];
+			}
+		}
+	}
+#endif
+}
+
+void UpdateBlocks(MeshModRender_OcclusionBuffer* buffer, uint32_t tileX0, uint32_t tileY0, uint32_t tileX1, uint32_t tileY1) {
+	for (uint32_t by = tileY0 / BlockSize; by < tileY1 / BlockSize; ++by) {
+		for (uint32_t bx = tileX0 / BlockSize; bx < tileX1 / BlockSize; ++bx) {
+			float const* block = buffer->depth + (size_t) by * BlockSize * buffer->width + bx * BlockSize;
+#if MMR_OCCLUSION_SSE
+			__m128 furthest = _mm_load_ps(block);
+			for (uint32_t y = 0; y < BlockSize; ++y) {
+				float const* row = block + (size_t) y * buffer->width;
+				furthest = _mm_max_ps(furthest, _mm_max_ps(_mm_load_ps(row), _mm_load_ps(row + 4)));
+			}
+			furthest = _mm_max_ps(furthest, _mm_shuffle_ps(furthest, furthest, _MM_SHUFFLE(1, 0, 3, 2)));
+			furthest = _mm_max_ps(furthest, _mm_shuffle_ps(furthest, furthest, _MM_SHUFFLE(2, 3, 0, 1)));
+			buffer->blockMaxDepth[by * buffer->blocksX + bx] = _mm_cvtss_f32(furthest);
+#else
+			float furthest = -FLT_MAX;
+			for (uint32_t y = 0; y < BlockSize; ++y) {
+				for (uint32_t x = 0; x < BlockSize; ++x) {
+					float const d = block[(size_t) y * buffer->width + x];
+					furthest = d > furthest ? d : furthest;
+				}
+			}
+			buffer->blockMaxDepth[by * buffer->blocksX + bx] = furthest;
+#endif
+		}
+	}
+}
+
+// clears, rasterises every triangle touching the tile then rebuilds its blocks.
+// Tiles share nothing so they run in parallel without locks
+void RasteriseTileJob(void* data, uint32_t tileIndex) {
+	auto buffer = (MeshModRender_OcclusionBuffer*) data;
+	uint32_t const tileX0 = (tileIndex % buffer->tilesX) * TileWidth;
+	uint32_t const tileY0 = (tileIndex / buffer->tilesX) * TileHeight;
+	uint32_t const tileX1 = tileX0 + TileWidth < buffer->width ? tileX0 + TileWidth : buffer->width;
+	uint32_t const tileY1 = tileY0 + TileHeight < buffer->height ? tileY0 + TileHeight : buffer->height;
+
+	for (uint32_t y = tileY0; y < tileY1; ++y) {
+		float* row = buffer->depth + (size_t) y * buffer->width;
+		for (uint32_t x = tileX0; x < tileX1; ++x) {
+			row[x] = FLT_MAX;
+		}
+	}
+
+	// every tile walks the whole list, the bounds reject is cheap next to binning
+	// at the small resolutions this is meant for
+	for (uint32_t i = 0; i < buffer->triangleCount; ++i) {
+		ScreenTriangle const& tri = buffer->triangles[i];
+		if (tri.maxX <= (int32_t) tileX0 || tri.minX >= (int32_t) tileX1 ||
+				tri.maxY <= (int32_t) tileY0 || tri.minY >= (int32_t) tileY1) {
+			continue;
+		}
+		RasteriseTriangle(buffer, tri, (int32_t) tileX0, (int32_t) tileY0, (int32_t) tileX1, (int32_t) tileY1);
+	}
+
+	UpdateBlocks(buffer, tileX0, tileY0, tileX1, tileY1);
+}
+
+} // end anonymous namespace
+
+MeshModRender_OcclusionBuffer* MeshModRender_OcclusionBufferCreate(MeshModRender_Heap* heap, uint32_t width, uint32_t height) {
+	width = (width + BlockSize - 1) & ~(BlockSize - 1);
+	height = (height + BlockSize - 1) & ~(BlockSize - 1);
+	if (width == 0 || height == 0) {
+		return nullptr;
+	}
+
+	auto buffer = (MeshModRender_OcclusionBuffer*) MeshModRender_HeapAlloc(*heap, sizeof(MeshModRender_OcclusionBuffer));
+	if (!buffer) {
+		return nullptr;
+	}
+	memset(buffer, 0, sizeof(MeshModRender_OcclusionBuffer));
+	buffer->heap = heap;
+	buffer->width = width;
+	buffer->height = height;
+	buffer->blocksX = width / BlockSize;
+	buffer->blocksY = height / BlockSize;
+	buffer->tilesX = (width + TileWidth - 1) / TileWidth;
+	buffer->tilesY = (height + TileHeight - 1) / TileHeight;
+
+	// heap blocks are 16 byte aligned and rows are a multiple of 8 floats
+	buffer->depth = (float*) MeshModRender_HeapAlloc(*heap, sizeof(float) * width * height);
+	buffer->blockMaxDepth = (float*) MeshModRender_HeapAlloc(*heap, sizeof(float) * buffer->blocksX * buffer->blocksY);
+	if (!buffer->depth || !buffer->blockMaxDepth) {
+		MeshModRender_OcclusionBufferDestroy(buffer);
+		return nullptr;
+	}
+	return buffer;
+}
+
+void MeshModRender_OcclusionBufferDestroy(MeshModRender_OcclusionBuffer* buffer) {
+	if (!buffer) {
+		return;
+	}
+	MeshModRender_Heap& heap = *buffer->heap;
+	MeshModRender_HeapFree(heap, buffer->triangles);
+	MeshModRender_HeapFree(heap, buffer->blockMaxDepth);
+	MeshModRender_HeapFree(heap, buffer->depth);
+	MeshModRender_HeapFree(heap, buffer);
+}
+
+void MeshModRender_OcclusionBufferBegin(MeshModRender_OcclusionBuffer* buffer,
+		Math_Mat4F const& worldToNDC,
+		Math_Mat4F const& viewToNDC) {
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			buffer->worldToClip[r * 4 + c] = worldToNDC.v[c * 4 + r];
+		}
+	}
+
+	// perspective ndc z is a + b / w so it grows with distance when the view w to
+	// clip z term is negative, reversed z flips it. Ortho assumes ndc z grows away
+	// from the camera as the front to back sort does
+	float const clipWFromZ = viewToNDC.v[2 * 4 + 3];
+	float const clipZFromW = viewToNDC.v[3 * 4 + 2];
+	buffer->depthSign = (clipWFromZ != 0.0f && clipZFromW > 0.0f) ? -1.0f : 1.0f;
+	buffer->nearZ = buffer->depthSign;
+	buffer->nearW = buffer->depthSign < 0.0f ? 1.0f : 0.0f;
+
+	buffer->triangleCount = 0;
+	buffer->valid = false;
+}
+
+bool MeshModRender_OcclusionBufferAddTriangles(MeshModRender_OcclusionBuffer* buffer,
+		Math_Mat4F const& localMatrix,
+		void const* positions,
+		uint32_t stride,
+		uint32_t triangleCount) {
+	float localToClip[16];
+	Multiply(buffer->worldToClip, localMatrix.v, localToClip);
+
+	auto base = (uint8_t const*) positions;
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		ClipVertex v[3];
+		float nearDistance[3];
+		uint32_t insideMask = 0;
+		for (uint32_t j = 0; j < 3; ++j) {
+			v[j] = Transform(localToClip, (float const*) (base + (size_t) (i * 3 + j) * stride));
+			nearDistance[j] = buffer->nearZ * v[j].z + buffer->nearW * v[j].w;
+			insideMask |= (nearDistance[j] >= 0.0f) ? (1u << j) : 0;
+		}
+
+		if (insideMask == 0x7) {
+			if (!PushTriangle(buffer, v[0], v[1], v[2])) {
+				return false;
+			}
+			continue;
+		}
+		if (insideMask == 0) {
+			continue;
+		}
+
+		// clip against the near plane, giving a triangle or a quad
+		ClipVertex clipped[4];
+		uint32_t clippedCount = 0;
+		for (uint32_t j = 0; j < 3; ++j) {
+			uint32_t const k = (j + 1) % 3;
+			bool const aInside = (insideMask >> j) & 1;
+			bool const bInside = (insideMask >> k) & 1;
+			if (aInside) {
+				clipped[clippedCount++] = v[j];
+			}
+			if (aInside != bInside) {
+				clipped[clippedCount++] = LerpToNearPlane(v[j], v[k], nearDistance[j], nearDistance[k]);
+			}
+		}
+		for (uint32_t j = 2; j < clippedCount; ++j) {
+			if (!PushTriangle(buffer, clipped[0], clipped[j - 1], clipped[j])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void MeshModRender_OcclusionBufferEnd(MeshModRender_OcclusionBuffer* buffer, MeshModRender_Workers* workers) {
+	MeshModRender_WorkersParallelFor(workers, buffer->tilesX * buffer->tilesY, &RasteriseTileJob, buffer);
+	buffer->valid = true;
+}
+
+void MeshModRender_OcclusionBufferInvalidate(MeshModRender_OcclusionBuffer* buffer) {
+	buffer->valid = false;
+}
+
+bool MeshModRender_OcclusionBufferTestBounds(MeshModRender_OcclusionBuffer const* buffer,
+		Math_Mat4F const& localMatrix,
+		Math_Vec3F const& boundsMin,
+		Math_Vec3F const& boundsMax) {
+	if (!buffer->valid) {
+		return true;
+	}
+
+	float localToClip[16];
+	Multiply(buffer->worldToClip, localMatrix.v, localToClip);
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	uint32_t behindCount = 0;
+	for (uint32_t i = 0; i < 8; ++i) {
+		float const corner[3] = {
+				(i & 1) ? boundsMax.x : boundsMin.x,
+				(i & 2) ? boundsMax.y : boundsMin.y,
+				(i & 4) ? boundsMax.z : boundsMin.z
+		};
+		ClipVertex const v = Transform(localToClip, corner);
+		// keep going to tell crossing the near plane from entirely behind it
+		if (buffer->nearZ * v.z + buffer->nearW * v.w < 0.0f) {
+			behindCount++;
+			continue;
+		}
+		float const invW = 1.0f / v.w;
+		float const x = (v.x * invW * 0.5f + 0.5f) * (float) buffer->width;
+		float const y = (0.5f - v.y * invW * 0.5f) * (float) buffer->height;
+		float const depth = v.z * invW * buffer->depthSign;
+		minX = x < minX ? x : minX;
+		maxX = x > maxX ? x : maxX;
+		minY = y < minY ? y : minY;
+		maxY = y > maxY ? y : maxY;
+		nearest = depth < nearest ? depth : nearest;
+	}
+	if (behindCount) {
+		return behindCount != 8;
+	}
+
+	if (maxX <= 0.0f || maxY <= 0.0f || minX >= (float) buffer->width || minY >= (float) buffer->height) {
+		return false;
+	}
+	uint32_t const x0 = minX > 0.0f ? (uint32_t) minX : 0;
+	uint32_t const y0 = minY > 0.0f ? (uint32_t) minY : 0;
+	uint32_t const x1 = maxX < (float) buffer->width ? (uint32_t) ceilf(maxX) : buffer->width;
+	uint32_t const y1 = maxY < (float) buffer->height ? (uint32_t) ceilf(maxY) : buffer->height;
+
+	for (uint32_t by = y0 / BlockSize; by <= (y1 - 1) / BlockSize; ++by) {
+		for (uint32_t bx = x0 / BlockSize; bx <= (x1 - 1) / BlockSize; ++bx) {
+			// every pixel in the block is nearer than the bounds
+			if (nearest > buffer->blockMaxDepth[by * buffer->blocksX + bx]) {
+				continue;
+			}
+
+			uint32_t const px0 = bx * BlockSize > x0 ? bx * BlockSize : x0;
+			uint32_t const py0 = by * BlockSize > y0 ? by * BlockSize : y0;
+			uint32_t const px1 = (bx + 1) * BlockSize < x1 ? (bx + 1) * BlockSize : x1;
+			uint32_t const py1 = (by + 1) * BlockSize < y1 ? (by + 1) * BlockSize : y1;
+			// the furthest pixel is inside the bounds if the block is
+			if (px1 - px0 == BlockSize && py1 - py0 == BlockSize) {
+				return true;
+			}
+			for (uint32_t y = py0; y < py1; ++y) {
+				float const* row = buffer->depth + (size_t) y * buffer->width;
+				for (uint32_t x = px0; x < px1; ++x) {
+					if (nearest <= row[x]) {
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
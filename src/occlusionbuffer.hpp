@@ -0,0 +1,48 @@
+#pragma once
+
+#include "al2o3_platform/platform.h"
+#include "al2o3_cmath/vector.h"
+#include "al2o3_cmath/matrix.h"
+
+struct MeshModRender_Workers;
+struct MeshModRender_Heap;
+
+// a small cpu depth buffer occluder triangles are rasterised into so anything
+// hidden behind them can be rejected before it's encoded. Depth is stored so
+// larger is further away and each 8x8 block also keeps its furthest depth, most
+// tests are answered from the blocks without touching pixels. Nothing here needs
+// a gpu so it can be driven and tested standalone
+struct MeshModRender_OcclusionBuffer;
+
+// width and height are rounded up to multiples of 8
+MeshModRender_OcclusionBuffer* MeshModRender_OcclusionBufferCreate(MeshModRender_Heap* heap, uint32_t width, uint32_t height);
+void MeshModRender_OcclusionBufferDestroy(MeshModRender_OcclusionBuffer* buffer);
+
+// starts a new set of occluders seen through the view. The matrices are column
+// major as uploaded, viewToNDC is only used to work out which way depth runs and
+// so which side of ndc z the near plane is on
+void MeshModRender_OcclusionBufferBegin(MeshModRender_OcclusionBuffer* buffer,
+		Math_Mat4F const& worldToNDC,
+		Math_Mat4F const& viewToNDC);
+
+// clips and sets up triangleCount triangles (3 positions each, stride bytes apart)
+// under a row major local matrix, they are rasterised by End. Returns false if out of memory
+bool MeshModRender_OcclusionBufferAddTriangles(MeshModRender_OcclusionBuffer* buffer,
+		Math_Mat4F const& localMatrix,
+		void const* positions,
+		uint32_t stride,
+		uint32_t triangleCount);
+
+// rasterises everything added since Begin, one worker job per screen tile
+void MeshModRender_OcclusionBufferEnd(MeshModRender_OcclusionBuffer* buffer, MeshModRender_Workers* workers);
+
+// marks the contents stale so every test passes until the next Begin/End
+void MeshModRender_OcclusionBufferInvalidate(MeshModRender_OcclusionBuffer* buffer);
+
+// false if the local bounds under the row major local matrix are off screen,
+// behind the camera or entirely behind the occluders. Conservative, anything
+// crossing the near plane is visible. Safe to call from several threads at once after End
+bool MeshModRender_OcclusionBufferTestBounds(MeshModRender_OcclusionBuffer const* buffer,
+		Math_Mat4F const& localMatrix,
+		Math_Vec3F const& boundsMin,
+		Math_Vec3F const& boundsMax);
@@ -0,0 +1,84 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_memory/memory.h"
+#include "al2o3_cadt/vector.h"
+#include "render_meshmodrender/render.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+#include "bvh.hpp"
+
+void MeshModRender_PickDataDestroy(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh) {
+	MeshModRender_BvhDestroy(mesh->bvh);
+	mesh->bvh = nullptr;
+	MeshModRender_PoolArrayFree(manager->pool, mesh->pickPositions);
+	MeshModRender_PoolArrayFree(manager->pool, mesh->pickPolygons);
+	MeshModRender_PoolArrayFree(manager->pool, mesh->pickPolygonIds);
+	mesh->pickTopologyHash = 0;
+}
+
+void MeshModRender_PickDataBuilt(MeshModRender_Manager* manager, MeshMod_MeshRenderable* mesh, uint64_t topologyHash) {
+	auto positions = (Math_Vec3F const*) mesh->pickPositions.data;
+	uint32_t const triangleCount = mesh->pickPolygons.count;
+
+	// same triangles in the same order means only positions moved, a refit keeps
+	// the tree shape which degrades a little with large motion but is far cheaper
+	if(topologyHash == mesh->pickTopologyHash &&
+			MeshModRender_BvhRefit(mesh->bvh, positions, triangleCount)) {
+		return;
+	}
+
+	MeshModRender_BvhDestroy(mesh->bvh);
+	mesh->bvh = MeshModRender_BvhCreate(manager->workers, &manager->pool, positions, triangleCount);
+	mesh->pickTopologyHash = topologyHash;
+	if(!mesh->bvh && triangleCount) {
+		LOGWARNING("MeshModRender out of memory building pick bvh");
+	}
+}
+
+AL2O3_EXTERN_C bool MeshModRender_MeshPick(MeshModRender_Manager* manager,
+		uint32_t count,
+		MeshModRender_MeshHandle const* mrhandles,
+		Math_Mat4F const* inverseLocalMatrices,
+		Math_Vec3F rayOrigin,
+		Math_Vec3F rayDirection,
+		float maxDistance,
+		MeshModRender_PickHit* hit) {
+	float bestT = maxDistance;
+	bool found = false;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		auto mesh = MeshModRender_LookupMesh(manager, mrhandles[i].handle);
+		if(!mesh->pickable || !mesh->bvh) {
+			continue;
+		}
+
+		// local matrices are row major, the direction isn't renormalised so t is
+		// the same in world and local space and hits compare across meshes
+		float const* m = inverseLocalMatrices[i].v;
+		Math_Vec3F origin;
+		Math_Vec3F direction;
+		origin.x = m[0] * rayOrigin.x + m[1] * rayOrigin.y + m[2] * rayOrigin.z + m[3];
+		origin.y = m[4] * rayOrigin.x + m[5] * rayOrigin.y + m[6] * rayOrigin.z + m[7];
+		origin.z = m[8] * rayOrigin.x + m[9] * rayOrigin.y + m[10] * rayOrigin.z + m[11];
+		direction.x = m[0] * rayDirection.x + m[1] * rayDirection.y + m[2] * rayDirection.z;
+		direction.y = m[4] * rayDirection.x + m[5] * rayDirection.y + m[6] * rayDirection.z;
+		direction.z = m[8] * rayDirection.x + m[9] * rayDirection.y + m[10] * rayDirection.z;
+
+		float t;
+		uint32_t triangle;
+		if(!MeshModRender_BvhIntersect(mesh->bvh, origin, direction, bestT, t, triangle)) {
+			continue;
+		}
+
+		bestT = t;
+		found = true;
+		hit->mesh = mrhandles[i];
+		hit->triangle = triangle;
+		hit->polygon = ((MeshMod_PolygonHandle const*) mesh->pickPolygons.data)[triangle];
+		hit->polygonValid = true;
+		hit->polygonId = ((uint32_t const*) mesh->pickPolygonIds.data)[triangle];
+		hit->distance = t;
+	}
+
+	return found;
+}
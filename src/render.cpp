@@ -11,63 +11,103 @@
 #include "render_basics/graphicsencoder.h"
 
 #include "meshrenderable.hpp"
-
-struct MeshModRender_RenderStyleMaterial {
-	Render_ShaderHandle shader;
-	Render_RootSignatureHandle rootSignature;
-	Render_PipelineHandle pipeline;
-	Render_DescriptorSetHandle descriptorSet;
-
-	bool copyDontFree;
-};
-
-struct MeshModRender_Manager {
-	Handle_Manager32* meshManager;
-	Render_RendererHandle renderer;
-
-	MeshModRender_RenderStyleMaterial styleMaterial[MMR_MAX];
-
-	union {
-		Render_GpuView view;
-		uint8_t spacer[UNIFORM_BUFFER_MIN_SIZE];
-	} viewUniforms;
-	Render_BufferHandle viewUniformBuffer;
-};
-
-static bool CreatePosColour(MeshModRender_Manager *manager, Render_ROPLayout const* targetLayout) {
-
-	VFile::ScopedFile vfile = VFile::FromFile("resources/poscolour_vertex.hlsl", Os_FM_Read);
+#include "manager.hpp"
+
+// a vertex shader entry point from vertexPath with fragmentPath's FS_main
+static Render_ShaderHandle LoadShader(MeshModRender_Manager *manager,
+		char const* vertexPath,
+		char const* vertexEntry,
+		char const* fragmentPath) {
+	VFile::ScopedFile vfile = VFile::FromFile(vertexPath, Os_FM_Read);
 	if (!vfile) {
-		return false;
+		return {0};
 	}
-	VFile::ScopedFile ffile = VFile::FromFile("resources/copycolour_fragment.hlsl", Os_FM_Read);
+	VFile::ScopedFile ffile = VFile::FromFile(fragmentPath, Os_FM_Read);
 	if (!ffile) {
+		return {0};
+	}
+	return Render_CreateShaderFromVFile(manager->renderer, vfile, vertexEntry, ffile, "FS_main");
+}
+
+// VS_multiview is only built if the device can write the slice from a vertex shader
+static bool LoadViewVariants(MeshModRender_Manager *manager,
+		char const* vertexPath,
+		char const* fragmentPath,
+		Render_ShaderHandle& shader,
+		Render_ShaderHandle& multiViewShader) {
+	shader = LoadShader(manager, vertexPath, "VS_main", fragmentPath);
+	if (!Render_ShaderHandleIsValid(shader)) {
 		return false;
 	}
+	if (manager->multiView) {
+		multiViewShader = LoadShader(manager, vertexPath, "VS_multiview", fragmentPath);
+		if (!Render_ShaderHandleIsValid(multiViewShader)) {
+			LOGWARNING("MeshModRender multi view shader %s failed, only a single view is supported", vertexPath);
+			manager->multiView = false;
+		}
+	}
+	return true;
+}
 
-	MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[MMR_RS_FACE_COLOURS];
+static bool CreateDepthOnlyShader(MeshModRender_Manager *manager, Render_ROPLayout const* targetLayout) {
+	// no depth buffer, no prepass
+	if(targetLayout->depthFormat == TinyImageFormat_UNDEFINED) {
+		return true;
+	}
 
-	material.shader = Render_CreateShaderFromVFile(manager->renderer, vfile, "VS_main", ffile, "FS_main");
+	return LoadViewVariants(manager,
+			"resources/depthonly_vertex.hlsl",
+			"resources/depthonly_fragment.hlsl",
+			manager->depthOnlyShader,
+			manager->depthOnlyMultiViewShader);
+}
 
-	if (!Render_ShaderHandleIsValid(material.shader)) {
+// the root signature is shared with the depth only shaders so prepass draws reuse the descriptor sets
+static bool CreateMaterialShaders(MeshModRender_Manager *manager,
+		MeshModRender_RenderStyleMaterial& material,
+		char const* vertexPath) {
+	if (!LoadViewVariants(manager, vertexPath, "resources/copycolour_fragment.hlsl", material.shader, material.multiViewShader)) {
 		return false;
 	}
 
+	Render_ShaderHandle candidates[] = {
+			material.shader,
+			material.multiViewShader,
+			manager->depthOnlyShader,
+			manager->depthOnlyMultiViewShader
+	};
+	Render_ShaderHandle shaders[4];
+	uint32_t shaderCount = 0;
+	for (Render_ShaderHandle const& shader : candidates) {
+		if (Render_ShaderHandleIsValid(shader)) {
+			shaders[shaderCount++] = shader;
+		}
+	}
+
 	Render_RootSignatureDesc rootSignatureDesc{};
-	rootSignatureDesc.shaderCount = 1;
-	rootSignatureDesc.shaders = &material.shader;
+	rootSignatureDesc.shaderCount = shaderCount;
+	rootSignatureDesc.shaders = shaders;
 	rootSignatureDesc.staticSamplerCount = 0;
 	material.rootSignature = Render_RootSignatureCreate(manager->renderer, &rootSignatureDesc);
-	if (!Render_RootSignatureHandleIsValid(material.rootSignature)) {
-		return false;
-	}
+	return Render_RootSignatureHandleIsValid(material.rootSignature);
+}
 
+// with a depth only shader also the prepass pipeline and a no depth write variant to shade after it
+static bool CreateVariantPipelines(MeshModRender_Manager *manager,
+		MeshModRender_RenderStyleMaterial const& material,
+		Render_ShaderHandle shader,
+		Render_ShaderHandle depthOnlyShader,
+		Render_StockVertexLayouts vertexLayout,
+		Render_ROPLayout const* targetLayout,
+		Render_PipelineHandle& pipeline,
+		Render_PipelineHandle& depthPrepassPipeline,
+		Render_PipelineHandle& afterPrepassPipeline) {
 	TinyImageFormat colourFormats[] = { targetLayout->colourFormats[0] };
 
 	Render_GraphicsPipelineDesc gfxPipeDesc{};
-	gfxPipeDesc.shader = material.shader;
+	gfxPipeDesc.shader = shader;
 	gfxPipeDesc.rootSignature = material.rootSignature;
-	gfxPipeDesc.vertexLayout = Render_GetStockVertexLayout(manager->renderer, Render_SVL_3D_COLOUR);
+	gfxPipeDesc.vertexLayout = Render_GetStockVertexLayout(manager->renderer, vertexLayout);
 	gfxPipeDesc.blendState = Render_GetStockBlendState(manager->renderer, Render_SBS_OPAQUE);
 	if(targetLayout->depthFormat == TinyImageFormat_UNDEFINED) {
 		gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_IGNORE);
@@ -81,201 +121,287 @@ static bool CreatePosColour(MeshModRender_Manager *manager, Render_ROPLayout con
 	gfxPipeDesc.sampleCount = 1;
 	gfxPipeDesc.sampleQuality = 0;
 	gfxPipeDesc.primitiveTopo = Render_PT_TRI_LIST;
-	material.pipeline = Render_GraphicsPipelineCreate(manager->renderer, &gfxPipeDesc);
-	if (!Render_PipelineHandleIsValid(material.pipeline)) {
+	pipeline = Render_GraphicsPipelineCreate(manager->renderer, &gfxPipeDesc);
+	if (!Render_PipelineHandleIsValid(pipeline)) {
 		return false;
 	}
 
-	Render_DescriptorSetDesc const setDesc = {
-			material.rootSignature,
-			Render_DUF_PER_FRAME,
-			1
-	};
+	if(!Render_ShaderHandleIsValid(depthOnlyShader)) {
+		return true;
+	}
 
-	material.descriptorSet = Render_DescriptorSetCreate(manager->renderer, &setDesc);
-	if (!Render_DescriptorSetHandleIsValid(material.descriptorSet)) {
+	gfxPipeDesc.shader = depthOnlyShader;
+	gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_READWRITE_LESS);
+	gfxPipeDesc.colourRenderTargetCount = 0;
+	gfxPipeDesc.colourFormats = nullptr;
+	depthPrepassPipeline = Render_GraphicsPipelineCreate(manager->renderer, &gfxPipeDesc);
+	if (!Render_PipelineHandleIsValid(depthPrepassPipeline)) {
 		return false;
 	}
-	Render_DescriptorDesc params[1];
-	params[0].name = "View";
-	params[0].type = Render_DT_BUFFER;
-	params[0].buffer = manager->viewUniformBuffer;
-	params[0].offset = 0;
-	params[0].size = sizeof(manager->viewUniforms);
-	Render_DescriptorPresetFrequencyUpdated(material.descriptorSet, 0, 1, params);
-
-	MeshModRender_RenderStyleMaterial& materialCopy = manager->styleMaterial[MMR_RS_TRIANGLE_COLOURS];
-	materialCopy = material;
-	materialCopy.copyDontFree = true;
 
-	return true;
+	gfxPipeDesc.shader = shader;
+	gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_READONLY_LESS_EQUAL);
+	gfxPipeDesc.colourRenderTargetCount = 1;
+	gfxPipeDesc.colourFormats = colourFormats;
+	afterPrepassPipeline = Render_GraphicsPipelineCreate(manager->renderer, &gfxPipeDesc);
+	return Render_PipelineHandleIsValid(afterPrepassPipeline);
 }
 
-static bool CreatePosNormal(MeshModRender_Manager *manager, Render_ROPLayout const* targetLayout) {
-	VFile::ScopedFile vfile = VFile::FromFile("resources/posnormal_vertex.hlsl", Os_FM_Read);
-	if (!vfile) {
+static bool CreateMaterialPipelines(MeshModRender_Manager *manager,
+		MeshModRender_RenderStyleMaterial& material,
+		Render_StockVertexLayouts vertexLayout,
+		Render_ROPLayout const* targetLayout) {
+	if (!CreateVariantPipelines(manager, material,
+			material.shader,
+			manager->depthOnlyShader,
+			vertexLayout,
+			targetLayout,
+			material.pipeline,
+			material.depthPrepassPipeline,
+			material.afterPrepassPipeline)) {
 		return false;
 	}
-	VFile::ScopedFile ffile = VFile::FromFile("resources/copycolour_fragment.hlsl", Os_FM_Read);
-	if (!ffile) {
-		VFile_Close(vfile);
-		return false;
+	if (Render_ShaderHandleIsValid(material.multiViewShader)) {
+		if (!CreateVariantPipelines(manager, material,
+				material.multiViewShader,
+				manager->depthOnlyMultiViewShader,
+				vertexLayout,
+				targetLayout,
+				material.multiViewPipeline,
+				material.multiViewDepthPrepassPipeline,
+				material.multiViewAfterPrepassPipeline)) {
+			return false;
+		}
 	}
 
-	MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[MMR_RS_NORMAL];
+	material.descriptorSet = MeshModRender_ViewDescriptorSetCreate(manager, material.rootSignature);
+	return Render_DescriptorSetHandleIsValid(material.descriptorSet);
+}
 
-	material.shader = Render_CreateShaderFromVFile(manager->renderer, vfile, "VS_main", ffile, "FS_main");
+static bool CreatePosColour(MeshModRender_Manager *manager, Render_ROPLayout const* targetLayout) {
+	MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[MMR_RS_FACE_COLOURS];
+	material.sortId = MMR_RS_FACE_COLOURS;
 
-	if (!Render_ShaderHandleIsValid(material.shader)) {
+	if (!CreateMaterialShaders(manager, material, "resources/poscolour_vertex.hlsl")) {
 		return false;
 	}
-
-	Render_RootSignatureDesc rootSignatureDesc{};
-	rootSignatureDesc.shaderCount = 1;
-	rootSignatureDesc.shaders = &material.shader;
-	rootSignatureDesc.staticSamplerCount = 0;
-	material.rootSignature = Render_RootSignatureCreate(manager->renderer, &rootSignatureDesc);
-	if (!Render_RootSignatureHandleIsValid(material.rootSignature)) {
+	if (!CreateMaterialPipelines(manager, material, Render_SVL_3D_COLOUR, targetLayout)) {
 		return false;
 	}
 
-	TinyImageFormat colourFormats[] = { targetLayout->colourFormats[0] };
+	MeshModRender_RenderStyleMaterial& materialCopy = manager->styleMaterial[MMR_RS_TRIANGLE_COLOURS];
+	materialCopy = material;
+	materialCopy.copyDontFree = true;
 
-	Render_GraphicsPipelineDesc gfxPipeDesc{};
-	gfxPipeDesc.shader = material.shader;
-	gfxPipeDesc.rootSignature = material.rootSignature;
-	gfxPipeDesc.vertexLayout = Render_GetStockVertexLayout(manager->renderer, Render_SVL_3D_NORMAL);
-	gfxPipeDesc.blendState = Render_GetStockBlendState(manager->renderer, Render_SBS_OPAQUE);
-	if(targetLayout->depthFormat == TinyImageFormat_UNDEFINED) {
-		gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_IGNORE);
-	} else {
-		gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_READWRITE_LESS);
-	}
-	gfxPipeDesc.rasteriserState = Render_GetStockRasterisationState(manager->renderer, Render_SRS_BACKCULL);
-	gfxPipeDesc.colourRenderTargetCount = 1;
-	gfxPipeDesc.colourFormats = colourFormats;
-	gfxPipeDesc.depthStencilFormat = targetLayout->depthFormat;
-	gfxPipeDesc.sampleCount = 1;
-	gfxPipeDesc.sampleQuality = 0;
-	gfxPipeDesc.primitiveTopo = Render_PT_TRI_LIST;
-	material.pipeline = Render_GraphicsPipelineCreate(manager->renderer, &gfxPipeDesc);
-	if (!Render_PipelineHandleIsValid(material.pipeline)) {
-		return false;
-	}
+	return true;
+}
 
-	Render_DescriptorSetDesc const setDesc = {
-			material.rootSignature,
-			Render_DUF_PER_FRAME,
-			1
-	};
+static bool CreatePosNormal(MeshModRender_Manager *manager, Render_ROPLayout const* targetLayout) {
+	MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[MMR_RS_NORMAL];
+	material.sortId = MMR_RS_NORMAL;
 
-	material.descriptorSet = Render_DescriptorSetCreate(manager->renderer, &setDesc);
-	if (!Render_DescriptorSetHandleIsValid(material.descriptorSet)) {
+	if (!CreateMaterialShaders(manager, material, "resources/posnormal_vertex.hlsl")) {
 		return false;
 	}
-	Render_DescriptorDesc params[1];
-	params[0].name = "View";
-	params[0].type = Render_DT_BUFFER;
-	params[0].buffer = manager->viewUniformBuffer;
-	params[0].offset = 0;
-	params[0].size = sizeof(manager->viewUniforms);
-	Render_DescriptorPresetFrequencyUpdated(material.descriptorSet, 0, 1, params);
-
-	return true;
+	return CreateMaterialPipelines(manager, material, Render_SVL_3D_NORMAL, targetLayout);
 }
 
 static bool CreateDot(MeshModRender_Manager *manager, Render_ROPLayout const* targetLayout) {
-	VFile::ScopedFile vfile = VFile::FromFile("resources/dot_vertex.hlsl", Os_FM_Read);
-	if (!vfile) {
-		return false;
-	}
-	VFile::ScopedFile ffile = VFile::FromFile("resources/copycolour_fragment.hlsl", Os_FM_Read);
-	if (!ffile) {
-		VFile_Close(vfile);
+	MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[MMR_RS_DOT];
+	material.sortId = MMR_RS_DOT;
+
+	if (!CreateMaterialShaders(manager, material, "resources/dot_vertex.hlsl")) {
 		return false;
 	}
+	return CreateMaterialPipelines(manager, material, Render_SVL_3D_NORMAL_COLOUR, targetLayout);
+}
 
-	MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[MMR_RS_DOT];
 
-	material.shader = Render_CreateShaderFromVFile(manager->renderer, vfile, "VS_main", ffile, "FS_main");
+static bool DrawDataGrow(MeshModRender_Heap& heap, MeshModRender_DrawData& draws) {
+	uint32_t const capacity = draws.capacity ? draws.capacity * 2 : 64;
 
-	if (!Render_ShaderHandleIsValid(material.shader)) {
-		return false;
+#define MMR_GROW_ARRAY(name) \
+	{ \
+		auto p = (decltype(draws.name)) MeshModRender_HeapRealloc(heap, draws.name, capacity * sizeof(*draws.name)); \
+		if(!p) { return false; } \
+		draws.name = p; \
 	}
+	MMR_GROW_ARRAY(vertexBuffer)
+	MMR_GROW_ARRAY(vertexCount)
+	MMR_GROW_ARRAY(descriptorSet)
+	MMR_GROW_ARRAY(localUniformBuffer)
+	MMR_GROW_ARRAY(renderStyle)
+	MMR_GROW_ARRAY(localBoundsMin)
+	MMR_GROW_ARRAY(localBoundsMax)
+	MMR_GROW_ARRAY(owner)
+#undef MMR_GROW_ARRAY
+
+	draws.capacity = capacity;
+	return true;
+}
 
-	Render_RootSignatureDesc rootSignatureDesc{};
-	rootSignatureDesc.shaderCount = 1;
-	rootSignatureDesc.shaders = &material.shader;
-	rootSignatureDesc.staticSamplerCount = 0;
-	material.rootSignature = Render_RootSignatureCreate(manager->renderer, &rootSignatureDesc);
-	if (!Render_RootSignatureHandleIsValid(material.rootSignature)) {
-		return false;
+static void DrawDataDestroy(MeshModRender_Heap& heap, MeshModRender_DrawData& draws) {
+	MeshModRender_HeapFree(heap, draws.vertexBuffer);
+	MeshModRender_HeapFree(heap, draws.vertexCount);
+	MeshModRender_HeapFree(heap, draws.descriptorSet);
+	MeshModRender_HeapFree(heap, draws.localUniformBuffer);
+	MeshModRender_HeapFree(heap, draws.renderStyle);
+	MeshModRender_HeapFree(heap, draws.localBoundsMin);
+	MeshModRender_HeapFree(heap, draws.localBoundsMax);
+	MeshModRender_HeapFree(heap, draws.owner);
+	memset(&draws, 0, sizeof(MeshModRender_DrawData));
+}
+
+static uint32_t DrawDataAdd(MeshModRender_Heap& heap, MeshModRender_DrawData& draws, Handle_Handle32 owner) {
+	if(draws.count == draws.capacity) {
+		if(!DrawDataGrow(heap, draws)) {
+			return ~0u;
+		}
 	}
 
-	TinyImageFormat colourFormats[] = { targetLayout->colourFormats[0] };
+	uint32_t const index = draws.count++;
+	draws.vertexBuffer[index] = {0};
+	draws.vertexCount[index] = 0;
+	draws.descriptorSet[index] = {0};
+	draws.localUniformBuffer[index] = {0};
+	draws.renderStyle[index] = MMR_MAX;
+	draws.localBoundsMin[index] = {0, 0, 0};
+	draws.localBoundsMax[index] = {0, 0, 0};
+	draws.owner[index] = owner;
+	return index;
+}
 
-	Render_GraphicsPipelineDesc gfxPipeDesc{};
-	gfxPipeDesc.shader = material.shader;
-	gfxPipeDesc.rootSignature = material.rootSignature;
-	gfxPipeDesc.vertexLayout = Render_GetStockVertexLayout(manager->renderer, Render_SVL_3D_NORMAL_COLOUR);
-	gfxPipeDesc.blendState = Render_GetStockBlendState(manager->renderer, Render_SBS_OPAQUE);
-	if(targetLayout->depthFormat == TinyImageFormat_UNDEFINED) {
-		gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_IGNORE);
-	} else {
-		gfxPipeDesc.depthState = Render_GetStockDepthState(manager->renderer, Render_SDS_READWRITE_LESS);
-	}
-	gfxPipeDesc.rasteriserState = Render_GetStockRasterisationState(manager->renderer, Render_SRS_BACKCULL);
-	gfxPipeDesc.colourRenderTargetCount = 1;
-	gfxPipeDesc.colourFormats = colourFormats;
-	gfxPipeDesc.depthStencilFormat = targetLayout->depthFormat;
-	gfxPipeDesc.sampleCount = 1;
-	gfxPipeDesc.sampleQuality = 0;
-	gfxPipeDesc.primitiveTopo = Render_PT_TRI_LIST;
-	material.pipeline = Render_GraphicsPipelineCreate(manager->renderer, &gfxPipeDesc);
-	if (!Render_PipelineHandleIsValid(material.pipeline)) {
-		return false;
+// keeps the arrays dense by moving the last entry into the removed slot
+static void DrawDataRemove(MeshModRender_Manager* manager, uint32_t index) {
+	MeshModRender_DrawData& draws = manager->draws;
+	ASSERT(index < draws.count);
+
+	uint32_t const last = --draws.count;
+	if(index != last) {
+		draws.vertexBuffer[index] = draws.vertexBuffer[last];
+		draws.vertexCount[index] = draws.vertexCount[last];
+		draws.descriptorSet[index] = draws.descriptorSet[last];
+		draws.localUniformBuffer[index] = draws.localUniformBuffer[last];
+		draws.renderStyle[index] = draws.renderStyle[last];
+		draws.localBoundsMin[index] = draws.localBoundsMin[last];
+		draws.localBoundsMax[index] = draws.localBoundsMax[last];
+		draws.owner[index] = draws.owner[last];
+
+		auto moved = MeshModRender_LookupMesh(manager, draws.owner[index]);
+		moved->drawIndex = index;
 	}
+}
 
-	Render_DescriptorSetDesc const setDesc = {
-			material.rootSignature,
-			Render_DUF_PER_FRAME,
-			1
-	};
+// cleared on block allocation and release, a recycled handle sees nothing of its previous owner
+static void ResetRenderable(MeshMod_MeshRenderable* mesh) {
+	memset(mesh, 0, sizeof(MeshMod_MeshRenderable));
+	mesh->drawIndex = ~0u;
+}
 
-	material.descriptorSet = Render_DescriptorSetCreate(manager->renderer, &setDesc);
-	if (!Render_DescriptorSetHandleIsValid(material.descriptorSet)) {
+static bool RenderableBlockAlloc(MeshModRender_Manager* manager, uint32_t block) {
+	auto renderables = (MeshMod_MeshRenderable*) MeshModRender_HeapAlloc(manager->heap,
+			sizeof(MeshMod_MeshRenderable) * MeshModRender_RenderableBlockSize);
+	if(!renderables) {
 		return false;
 	}
-	Render_DescriptorDesc params[1];
-	params[0].name = "View";
-	params[0].type = Render_DT_BUFFER;
-	params[0].buffer = manager->viewUniformBuffer;
-	params[0].offset = 0;
-	params[0].size = sizeof(manager->viewUniforms);
-	Render_DescriptorPresetFrequencyUpdated(material.descriptorSet, 0, 1, params);
-
+	for(uint32_t i = 0; i < MeshModRender_RenderableBlockSize; ++i) {
+		ResetRenderable(renderables + i);
+	}
+	manager->renderableBlocks[block] = renderables;
 	return true;
 }
 
+// under handleLock when concurrent, 0 if out of slots or memory
+static Handle_Handle32 RenderableAlloc(MeshModRender_Manager* manager) {
+	size_t const freeCount = CADT_VectorSize(manager->freeRenderables);
+	if(freeCount) {
+		uint32_t const handle = *(uint32_t*) CADT_VectorAt(manager->freeRenderables, freeCount - 1);
+		CADT_VectorResize(manager->freeRenderables, freeCount - 1);
+		return handle;
+	}
+	uint32_t const block = manager->renderableCount / MeshModRender_RenderableBlockSize;
+	if(block == MeshModRender_RenderableMaxBlocks ||
+			(!manager->renderableBlocks[block] && !RenderableBlockAlloc(manager, block))) {
+		LOGERROR("MeshModRender out of renderables");
+		return 0;
+	}
+	return manager->renderableCount++;
+}
 
 AL2O3_EXTERN_C MeshModRender_Manager* MeshModRender_ManagerCreate(Render_RendererHandle renderer, Render_ROPLayout const* targetLayout) {
-	auto manager = (MeshModRender_Manager*) MEMORY_CALLOC(1, sizeof(MeshModRender_Manager));
+	static MeshModRender_ManagerDesc const defaultDesc{
+			false,
+			0,
+			0,
+			nullptr,
+			0,
+			nullptr,
+			0,
+			0,
+			0,
+			false
+	};
+	return MeshModRender_ManagerCreateWithDesc(renderer, targetLayout, &defaultDesc);
+}
+
+AL2O3_EXTERN_C MeshModRender_Manager* MeshModRender_ManagerCreateWithDesc(Render_RendererHandle renderer,
+																																					 Render_ROPLayout const* targetLayout,
+																																					 MeshModRender_ManagerDesc const* desc) {
+	Memory_Allocator* allocator = desc->allocator ? desc->allocator : &Memory_GlobalAllocator;
+	auto manager = (MeshModRender_Manager*) allocator->calloc(1, sizeof(MeshModRender_Manager));
 	if(!manager) {
 		return nullptr;
 	}
+	manager->heap.allocator = allocator;
+	uint32_t const scratchBytes = desc->scratchBytes ? desc->scratchBytes : MeshModRender_DefaultScratchBytes;
+	if(!MeshModRender_ScratchCreate(manager->scratch, &manager->heap, scratchBytes)) {
+		allocator->free(manager);
+		return nullptr;
+	}
+	if(!MeshModRender_PoolCreate(manager->pool, &manager->heap)) {
+		MeshModRender_ScratchDestroy(manager->scratch);
+		allocator->free(manager);
+		return nullptr;
+	}
 
 	manager->renderer = renderer;
-	manager->meshManager = Handle_Manager32Create(sizeof(MeshMod_MeshRenderable), 1024*16, 32, false);
+	manager->concurrent = desc->concurrent;
+	manager->framesInFlight = desc->framesInFlight;
+	manager->multiView = desc->multiView;
+	manager->occlusionWidth = desc->occlusionWidth ? desc->occlusionWidth : MeshModRender_DefaultOcclusionWidth;
+	manager->occlusionHeight = desc->occlusionHeight ? desc->occlusionHeight : MeshModRender_DefaultOcclusionHeight;
+	if(manager->framesInFlight > MeshModRender_MaxFramesInFlight) {
+		LOGWARNING("MeshModRender framesInFlight %u clamped to %u", manager->framesInFlight, MeshModRender_MaxFramesInFlight);
+		manager->framesInFlight = MeshModRender_MaxFramesInFlight;
+	}
 
-	static Render_BufferUniformDesc const ubDesc{
-			sizeof(manager->viewUniforms),
-			true
-	};
+	manager->freeRenderables = CADT_VectorCreate(sizeof(uint32_t));
+	manager->renderableCount = 1;
+	manager->streamChunk = (uint8_t*) MeshModRender_HeapAlloc(manager->heap, MeshModRender_StreamChunkSize);
+	manager->workers = MeshModRender_WorkersCreate(desc->workerThreadCount);
+	manager->asyncBuilds = CADT_VectorCreate(sizeof(MeshModRender_AsyncBuild*));
+	manager->asyncBuildsFree = CADT_VectorCreate(sizeof(MeshModRender_AsyncBuild*));
+	if(desc->cacheDirectory) {
+		manager->cache = MeshModRender_CacheCreate(desc->cacheDirectory,
+				desc->cacheMaxBytes ? desc->cacheMaxBytes : MeshModRender_DefaultCacheMaxBytes);
+	}
 
-	manager->viewUniformBuffer = Render_BufferCreateUniform(manager->renderer, &ubDesc);
-	if (!Render_BufferHandleIsValid(manager->viewUniformBuffer)) {
+	if(!manager->freeRenderables || !RenderableBlockAlloc(manager, 0)) {
+		MeshModRender_ManagerDestroy(manager);
+		return nullptr;
+	}
+	if(!MeshModRender_CommandQueuesCreate(manager)) {
+		MeshModRender_ManagerDestroy(manager);
 		return nullptr;
 	}
+	if (!MeshModRender_ViewRingCreate(manager)) {
+		MeshModRender_ManagerDestroy(manager);
+		return nullptr;
+	}
+
+	if( !CreateDepthOnlyShader(manager, targetLayout) ) {
+		LOGWARNING("MeshModRender depth only shader failed, depth prepass disabled");
+	}
 
 	if( !CreatePosColour(manager, targetLayout) ) {
 		MeshModRender_ManagerDestroy(manager);
@@ -299,125 +425,244 @@ AL2O3_EXTERN_C void MeshModRender_ManagerDestroy( MeshModRender_Manager* manager
 		return;
 	}
 
+	// apply anything still queued so destroys release their gpu objects
+	if(manager->concurrent && manager->drainCommands) {
+		MeshModRender_CommandDrain(manager);
+	}
+	MeshModRender_AsyncBuildsDestroy(manager);
+	MeshModRender_WorkersDestroy(manager->asyncWorkers);
+	MeshModRender_ReleaseAll(manager);
+	MeshModRender_CommandQueuesDestroy(manager);
+	MeshModRender_WorkersDestroy(manager->workers);
+	MeshModRender_CacheDestroy(manager->cache);
+
 	for (uint32_t i = 0u; i < MMR_MAX; ++i) {
 		MeshModRender_RenderStyleMaterial& material = manager->styleMaterial[i];
 		if(material.copyDontFree) {
 			continue;
 		}
 		Render_DescriptorSetDestroy(manager->renderer, material.descriptorSet);
+		if(Render_ShaderHandleIsValid(material.multiViewShader)) {
+			if(Render_PipelineHandleIsValid(material.multiViewAfterPrepassPipeline)) {
+				Render_PipelineDestroy(manager->renderer, material.multiViewAfterPrepassPipeline);
+			}
+			if(Render_PipelineHandleIsValid(material.multiViewDepthPrepassPipeline)) {
+				Render_PipelineDestroy(manager->renderer, material.multiViewDepthPrepassPipeline);
+			}
+			if(Render_PipelineHandleIsValid(material.multiViewPipeline)) {
+				Render_PipelineDestroy(manager->renderer, material.multiViewPipeline);
+			}
+			Render_ShaderDestroy(manager->renderer, material.multiViewShader);
+		}
+		if(Render_PipelineHandleIsValid(material.afterPrepassPipeline)) {
+			Render_PipelineDestroy(manager->renderer, material.afterPrepassPipeline);
+		}
+		if(Render_PipelineHandleIsValid(material.depthPrepassPipeline)) {
+			Render_PipelineDestroy(manager->renderer, material.depthPrepassPipeline);
+		}
 		Render_PipelineDestroy(manager->renderer, material.pipeline);
 		Render_RootSignatureDestroy(manager->renderer, material.rootSignature);
 		Render_ShaderDestroy(manager->renderer, material.shader);
 	}
 
+	if(Render_ShaderHandleIsValid(manager->depthOnlyShader)) {
+		Render_ShaderDestroy(manager->renderer, manager->depthOnlyShader);
+	}
+	if(Render_ShaderHandleIsValid(manager->depthOnlyMultiViewShader)) {
+		Render_ShaderDestroy(manager->renderer, manager->depthOnlyMultiViewShader);
+	}
 	Render_BufferDestroy(manager->renderer, manager->viewUniformBuffer);
 
-	Handle_Manager32Destroy(manager->meshManager);
-	MEMORY_FREE(manager);
+	for(uint32_t i = 0; i < MeshModRender_RenderableMaxBlocks && manager->renderableBlocks[i]; ++i) {
+		MeshModRender_HeapFree(manager->heap, manager->renderableBlocks[i]);
+	}
+	if(manager->freeRenderables) {
+		CADT_VectorDestroy(manager->freeRenderables);
+	}
+	MeshModRender_OcclusionBufferDestroy(manager->occlusion);
+	DrawDataDestroy(manager->heap, manager->draws);
+	MeshModRender_HeapFree(manager->heap, manager->streamChunk);
+	MeshModRender_PoolDestroy(manager->pool);
+	MeshModRender_ScratchDestroy(manager->scratch);
+	manager->heap.allocator->free(manager);
+}
+
+AL2O3_EXTERN_C void MeshModRender_ManagerGetMemoryStats(MeshModRender_Manager* manager, MeshModRender_MemoryStats* stats) {
+	MeshModRender_CountersGet(manager->heap.counters, stats->heap);
+	MeshModRender_CountersGet(manager->scratch.counters, stats->scratch);
+	MeshModRender_CountersGet(manager->pool.counters, stats->pool);
+}
+
+void MeshModRender_ApplyMeshCreate(MeshModRender_Manager* manager, Handle_Handle32 handle) {
+	// updates queued before the drain are already counted in queuedUpdates
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	// the draw data starts with style MMR_MAX to force a change
+	mesh->drawIndex = DrawDataAdd(manager->heap, manager->draws, handle);
+	if(mesh->drawIndex == ~0u) {
+		LOGERROR("MeshModRender out of memory growing draw data");
+		return;
+	}
+
+	MeshModRender_ApplyMeshSetStyle(manager, handle, MMR_RS_FACE_COLOURS);
 }
 
 AL2O3_EXTERN_C MeshModRender_MeshHandle MeshModRender_MeshCreate(MeshModRender_Manager* manager, MeshMod_MeshHandle mhandle) {
 	MeshModRender_MeshHandle mrhandle;
-	mrhandle.handle = Handle_Manager32Alloc(manager->meshManager);
 
-	auto mesh = (MeshMod_MeshRenderable*) Handle_Manager32HandleToPtr(manager->meshManager, mrhandle.handle);
+	if(manager->concurrent) {
+		Thread_MutexAcquire(&manager->handleLock);
+	}
+	mrhandle.handle = RenderableAlloc(manager);
+	if(manager->concurrent) {
+		Thread_MutexRelease(&manager->handleLock);
+	}
+	if(mrhandle.handle == 0) {
+		return mrhandle;
+	}
+	// set before the handle is returned so updates from other threads can snapshot it
+	auto mesh = MeshModRender_LookupMesh(manager, mrhandle.handle);
 	mesh->MMMesh = mhandle;
 	mesh->renderer = manager->renderer;
-	mesh->renderStyle = MMR_MAX; // force a change
 
-	MeshModRender_MeshSetStyle(manager, mrhandle, MMR_RS_FACE_COLOURS);
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshCreate(manager, mrhandle.handle);
+		return mrhandle;
+	}
 
+	// renders are skipped until the create is drained
+	MeshModRender_Command command;
+	command.type = MMR_CMD_CREATE;
+	command.handle = mrhandle.handle;
+	MeshModRender_CommandPush(manager, command);
 
 	return mrhandle;
 }
 
-AL2O3_EXTERN_C void MeshModRender_MeshDestroy(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
-	auto mesh = (MeshMod_MeshRenderable*) Handle_Manager32HandleToPtr(manager->meshManager, mrhandle.handle);
+void MeshModRender_ApplyMeshDestroy(MeshModRender_Manager* manager, Handle_Handle32 handle) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	MeshModRender_DrawData& draws = manager->draws;
 
-	Render_DescriptorSetDestroy(mesh->renderer, mesh->descriptorSet);
-	Render_BufferDestroy(mesh->renderer, mesh->localUniformBuffer);
-	CADT_VectorDestroy(mesh->cpuVertexBuffer);
-	Render_BufferDestroy(mesh->renderer, mesh->gpuVertexBuffer);
+	MeshModRender_AsyncBuildOrphan(mesh);
+	if(mesh->drawIndex != ~0u) {
+		MeshModRender_ReleaseDescriptorSet(manager, draws.descriptorSet[mesh->drawIndex]);
+		MeshModRender_ReleaseBuffer(manager, draws.localUniformBuffer[mesh->drawIndex]);
+		MeshModRender_ReleaseBuffer(manager, draws.vertexBuffer[mesh->drawIndex]);
+		DrawDataRemove(manager, mesh->drawIndex);
+	}
+	MeshModRender_PoolArrayFree(manager->pool, mesh->cpuVertexBuffer);
+	MeshModRender_PickDataDestroy(manager, mesh);
+	ResetRenderable(mesh);
 
-	Handle_Manager32Release(manager->meshManager, mrhandle.handle);
+	if(manager->concurrent) {
+		Thread_MutexAcquire(&manager->handleLock);
+	}
+	CADT_VectorPushElement(manager->freeRenderables, &handle);
+	if(manager->concurrent) {
+		Thread_MutexRelease(&manager->handleLock);
+	}
 }
 
-AL2O3_EXTERN_C void MeshModRender_MeshSetStyle(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, MeshModRender_RenderStyle style) {
-	auto mesh = (MeshMod_MeshRenderable*) Handle_Manager32HandleToPtr(manager->meshManager, mrhandle.handle);
-	if(style != mesh->renderStyle) {
-		// destroy old buffers
-		CADT_VectorDestroy(mesh->cpuVertexBuffer);
-		Render_BufferDestroy(mesh->renderer, mesh->gpuVertexBuffer);
-		Render_DescriptorSetDestroy(mesh->renderer, mesh->descriptorSet);
-		Render_BufferDestroy(mesh->renderer, mesh->localUniformBuffer);
+AL2O3_EXTERN_C void MeshModRender_MeshDestroy(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
+	// a failed create, slot 0 is never released
+	if(mrhandle.handle == 0) {
+		return;
+	}
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshDestroy(manager, mrhandle.handle);
+		return;
+	}
 
-		mesh->gpuVertexBufferCount = 0;
+	MeshModRender_Command command;
+	command.type = MMR_CMD_DESTROY;
+	command.handle = mrhandle.handle;
+	MeshModRender_CommandPush(manager, command);
+}
+
+void MeshModRender_ApplyMeshSetStyle(MeshModRender_Manager* manager, Handle_Handle32 handle, MeshModRender_RenderStyle style) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	MeshModRender_DrawData& draws = manager->draws;
+	uint32_t const index = mesh->drawIndex;
+	if(index == ~0u) {
+		return;
+	}
+
+	if(style != draws.renderStyle[index]) {
+		// destroy old buffers
+		MeshModRender_PoolArrayFree(manager->pool, mesh->cpuVertexBuffer);
+		MeshModRender_ReleaseBuffer(manager, draws.vertexBuffer[index]);
+		MeshModRender_ReleaseDescriptorSet(manager, draws.descriptorSet[index]);
+		MeshModRender_ReleaseBuffer(manager, draws.localUniformBuffer[index]);
+
+		draws.vertexBuffer[index] = {0};
+		draws.vertexCount[index] = 0;
+		mesh->gpuVertexBufferCapacity = 0;
 		mesh->storedPosHash = 0;
 		mesh->storedNormalHash = 0;
+		mesh->storedTopologyHash = 0;
+		mesh->cacheWritten = false;
 
-		uint32_t sizeOfVertex = 0;
-		switch(style) {
-			case MMR_RS_FACE_COLOURS:
-			case MMR_RS_TRIANGLE_COLOURS:
-				sizeOfVertex = sizeof(VertexPosColour);
-				break;
-
-			case MMR_RS_NORMAL:
-				sizeOfVertex = sizeof(VertexPosNormal);
-				break;
-			case MMR_RS_DOT:
-				sizeOfVertex = sizeof(VertexPosNormalColour);
-				break;
-
-			case MMR_MAX:
-				break;
-		}
-		ASSERT(sizeOfVertex);
-
-		mesh->cpuVertexBuffer = CADT_VectorCreate(sizeOfVertex);
-		mesh->renderStyle = style;
+		draws.renderStyle[index] = style;
 
-		MeshModRender_RenderStyleMaterial const& material = manager->styleMaterial[mesh->renderStyle];
+		MeshModRender_RenderStyleMaterial const& material = manager->styleMaterial[style];
 
 		static Render_BufferUniformDesc const ubDesc{
-				sizeof(mesh->localUniforms),
+				sizeof(MeshModRender_LocalUniforms),
 				true
 		};
-		mesh->localUniformBuffer = Render_BufferCreateUniform(manager->renderer, &ubDesc);
+		draws.localUniformBuffer[index] = Render_BufferCreateUniform(manager->renderer, &ubDesc);
 
 		Render_DescriptorSetDesc const setDesc = {
 				material.rootSignature,
 				Render_DUF_PER_DRAW,
 				1
 		};
-		mesh->descriptorSet = Render_DescriptorSetCreate(manager->renderer, &setDesc);
+		draws.descriptorSet[index] = Render_DescriptorSetCreate(manager->renderer, &setDesc);
 		Render_DescriptorDesc params[1];
 		params[0].name = "LocalToWorld";
 		params[0].type = Render_DT_BUFFER;
-		params[0].buffer = mesh->localUniformBuffer;
+		params[0].buffer = draws.localUniformBuffer[index];
 		params[0].offset = 0;
-		params[0].size = sizeof(mesh->localUniforms);
-		Render_DescriptorPresetFrequencyUpdated(mesh->descriptorSet, 0, 1, params);
+		params[0].size = sizeof(MeshModRender_LocalUniforms);
+		Render_DescriptorPresetFrequencyUpdated(draws.descriptorSet[index], 0, 1, params);
 
 	}
 
 }
 
-AL2O3_EXTERN_C void MeshModRender_MeshUpdate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
-	auto mesh = (MeshMod_MeshRenderable*) Handle_Manager32HandleToPtr(manager->meshManager, mrhandle.handle);
+AL2O3_EXTERN_C void MeshModRender_MeshSetStyle(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, MeshModRender_RenderStyle style) {
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshSetStyle(manager, mrhandle.handle, style);
+		return;
+	}
+
+	MeshModRender_Command command;
+	command.type = MMR_CMD_SET_STYLE;
+	command.handle = mrhandle.handle;
+	command.style = style;
+	MeshModRender_CommandPush(manager, command);
+}
+
+void MeshModRender_ApplyMeshUpdate(MeshModRender_Manager* manager, Handle_Handle32 handle) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	if(mesh->drawIndex == ~0u) {
+		return;
+	}
+
+	// an async build in flight would otherwise land on top of this one
+	MeshModRender_AsyncBuildFinish(manager, mesh);
 
-	switch(mesh->renderStyle) {
+	switch(manager->draws.renderStyle[mesh->drawIndex]) {
 		case MMR_RS_FACE_COLOURS:
-			VertexPosColour::UpdateIfNeededFaceColours(mesh);
+			VertexPosColour::UpdateIfNeededFaceColours(manager, mesh);
 			break;
 		case MMR_RS_TRIANGLE_COLOURS:
-			VertexPosColour::UpdateIfNeededTriColours(mesh);
+			VertexPosColour::UpdateIfNeededTriColours(manager, mesh);
 			break;
 		case MMR_RS_NORMAL:
-			VertexPosNormal::UpdateIfNeeded(mesh);
+			VertexPosNormal::UpdateIfNeeded(manager, mesh);
 			break;
 		case MMR_RS_DOT:
-			VertexPosNormalColour::UpdateIfNeeded(mesh);
+			VertexPosNormalColour::UpdateIfNeeded(manager, mesh);
 			break;
 		case MMR_MAX:
 			break;
@@ -425,15 +670,84 @@ AL2O3_EXTERN_C void MeshModRender_MeshUpdate(MeshModRender_Manager* manager, Mes
 
 }
 
-AL2O3_EXTERN_C void MeshModRender_ManagerSetView(MeshModRender_Manager* manager, Render_GpuView* view) {
-	// upload the uniforms
-	memcpy(&manager->viewUniforms, view, sizeof(Render_GpuView));
-	Render_BufferUpdateDesc uniformUpdate = {
-			&manager->viewUniforms,
-			0,
-			sizeof(manager->viewUniforms)
-	};
-	Render_BufferUpload(manager->viewUniformBuffer, &uniformUpdate);
+AL2O3_EXTERN_C void MeshModRender_MeshUpdate(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle) {
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshUpdate(manager, mrhandle.handle);
+		return;
+	}
+
+	MeshModRender_PushMeshUpdate(manager, mrhandle.handle, MMR_CMD_UPDATE);
+}
+
+void MeshModRender_ApplyMeshSetRetainCpuCopy(MeshModRender_Manager* manager, Handle_Handle32 handle, bool retain) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	if(mesh->drawIndex == ~0u || retain == mesh->retainCpuCopy) {
+		return;
+	}
+
+	mesh->retainCpuCopy = retain;
+	if(retain) {
+		// force a rebuild on the next update so the copy gets filled
+		mesh->storedPosHash = 0;
+		mesh->storedNormalHash = 0;
+		mesh->storedTopologyHash = 0;
+	} else {
+		MeshModRender_PoolArrayFree(manager->pool, mesh->cpuVertexBuffer);
+	}
+}
+
+AL2O3_EXTERN_C void MeshModRender_MeshSetRetainCpuCopy(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, bool retain) {
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshSetRetainCpuCopy(manager, mrhandle.handle, retain);
+		return;
+	}
+
+	MeshModRender_Command command;
+	command.type = MMR_CMD_SET_RETAIN_CPU_COPY;
+	command.handle = mrhandle.handle;
+	command.retain = retain;
+	MeshModRender_CommandPush(manager, command);
+}
+
+void MeshModRender_ApplyMeshSetPickable(MeshModRender_Manager* manager, Handle_Handle32 handle, bool pickable) {
+	auto mesh = MeshModRender_LookupMesh(manager, handle);
+	if(mesh->drawIndex == ~0u || pickable == mesh->pickable) {
+		return;
+	}
+
+	mesh->pickable = pickable;
+	if(pickable) {
+		// force a rebuild on the next update so the pick data gets captured
+		mesh->storedPosHash = 0;
+		mesh->storedNormalHash = 0;
+		mesh->storedTopologyHash = 0;
+	} else {
+		MeshModRender_PickDataDestroy(manager, mesh);
+	}
+}
+
+AL2O3_EXTERN_C void MeshModRender_MeshSetPickable(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, bool pickable) {
+	if(!manager->concurrent) {
+		MeshModRender_ApplyMeshSetPickable(manager, mrhandle.handle, pickable);
+		return;
+	}
+
+	MeshModRender_Command command;
+	command.type = MMR_CMD_SET_PICKABLE;
+	command.handle = mrhandle.handle;
+	command.pickable = pickable;
+	MeshModRender_CommandPush(manager, command);
+}
+
+AL2O3_EXTERN_C void const* MeshModRender_MeshGetCpuVertices(MeshModRender_Manager* manager, MeshModRender_MeshHandle mrhandle, uint32_t* vertexCount) {
+	auto mesh = MeshModRender_LookupMesh(manager, mrhandle.handle);
+	// empty until the first update after a concurrent create or retain is drained
+	if(!mesh->retainCpuCopy || !mesh->cpuVertexBuffer.count) {
+		*vertexCount = 0;
+		return nullptr;
+	}
+	*vertexCount = mesh->cpuVertexBuffer.count;
+	return mesh->cpuVertexBuffer.data;
 }
 
 AL2O3_EXTERN_C void MeshModRender_MeshRender(MeshModRender_Manager* manager,
@@ -442,24 +756,19 @@ AL2O3_EXTERN_C void MeshModRender_MeshRender(MeshModRender_Manager* manager,
 																						 Math_Mat4F localMatrix,
 																						 Math_Mat4F inverseLocalMatrix) {
 
-	auto mesh = (MeshMod_MeshRenderable*) Handle_Manager32HandleToPtr(manager->meshManager, mrhandle.handle);
-
-	// upload the uniforms
-	memcpy(&mesh->localUniforms.localToWorld, Math_TransposeMat4F(localMatrix).v, sizeof(Math_Mat4F));
-	memcpy(&mesh->localUniforms.localToWorldTranspose, inverseLocalMatrix.v, sizeof(Math_Mat4F));
-	Render_BufferUpdateDesc uniformUpdate = {
-			&mesh->localUniforms,
-			0,
-			sizeof(mesh->localUniforms)
-	};
-	Render_BufferUpload(mesh->localUniformBuffer, &uniformUpdate);
-
-	MeshModRender_RenderStyleMaterial const& material = manager->styleMaterial[mesh->renderStyle];
+	auto mesh = MeshModRender_LookupMesh(manager, mrhandle.handle);
+	uint32_t const index = mesh->drawIndex;
+	if(index == ~0u) {
+		// create not drained yet
+		return;
+	}
 
-	Render_GraphicsEncoderBindDescriptorSet(encoder, material.descriptorSet, 0);
-	Render_GraphicsEncoderBindDescriptorSet(encoder, mesh->descriptorSet, 0);
-	Render_GraphicsEncoderBindVertexBuffer(encoder, mesh->gpuVertexBuffer, 0);
-	Render_GraphicsEncoderBindPipeline(encoder, material.pipeline);
-	Render_GraphicsEncoderDraw(encoder, mesh->gpuVertexBufferCount, 0);
+	MeshModRender_RenderStyleMaterial const& material = manager->styleMaterial[manager->draws.renderStyle[index]];
 
+	Render_GraphicsEncoderBindDescriptorSet(encoder, material.descriptorSet, MeshModRender_ViewSetIndex(manager->viewSlot, 0));
+	Render_GraphicsEncoderBindPipeline(encoder, manager->viewCount > 1 ? material.multiViewPipeline : material.pipeline);
+	MeshModRender_LocalUniforms localUniforms;
+	MeshModRender_ComputeLocalUniforms(&localMatrix, &inverseLocalMatrix, 1, &localUniforms);
+	MeshModRender_UploadLocalUniforms(manager, index, localUniforms);
+	MeshModRender_EncodeDraw(manager, encoder, index, manager->viewCount);
 }
@@ -0,0 +1,218 @@
+#include "al2o3_platform/platform.h"
+#include "render_meshmodrender/render.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MMR_TRANSFORM_SSE 1
+#include <emmintrin.h>
+#else
+#define MMR_TRANSFORM_SSE 0
+#endif
+
+namespace {
+
+// relative tolerance for treating a 3x3 as a rotation times a uniform scale
+float const RigidEpsilon = 1e-5f;
+
+// full 4x4 inverse by cofactors, only for the rare projective local matrix.
+// Works for either majority as inverse and transpose commute
+void InverseGeneral(float const* m, float* out) {
+	float inv[16];
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float const det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	float const invDet = (det != 0.0f) ? 1.0f / det : 0.0f;
+	for(int i = 0; i < 16; ++i) {
+		out[i] = inv[i] * invDet;
+	}
+}
+
+bool IsAffine(float const* m) {
+	return m[12] == 0.0f && m[13] == 0.0f && m[14] == 0.0f && m[15] == 1.0f;
+}
+
+bool IsRigid(float aa, float bb, float cc, float ab, float bc, float ca) {
+	float const tolerance = aa * RigidEpsilon;
+	return aa > 0.0f &&
+			fabsf(aa - bb) <= tolerance && fabsf(aa - cc) <= tolerance &&
+			fabsf(ab) <= tolerance && fabsf(bc) <= tolerance && fabsf(ca) <= tolerance;
+}
+
+#if MMR_TRANSFORM_SSE
+inline void Transpose(float const* in, float* out) {
+	__m128 r0 = _mm_loadu_ps(in + 0);
+	__m128 r1 = _mm_loadu_ps(in + 4);
+	__m128 r2 = _mm_loadu_ps(in + 8);
+	__m128 r3 = _mm_loadu_ps(in + 12);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(out + 0, r0);
+	_mm_storeu_ps(out + 4, r1);
+	_mm_storeu_ps(out + 8, r2);
+	_mm_storeu_ps(out + 12, r3);
+}
+
+// w must be zero in both, the result is splatted to all lanes
+inline __m128 Dot3(__m128 a, __m128 b) {
+	__m128 m = _mm_mul_ps(a, b);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+inline __m128 Cross(__m128 a, __m128 b) {
+	__m128 const aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 const bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 const c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+void InverseAffine(float const* m, float* out) {
+	__m128 const xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	__m128 const r0 = _mm_loadu_ps(m + 0);
+	__m128 const r1 = _mm_loadu_ps(m + 4);
+	__m128 const r2 = _mm_loadu_ps(m + 8);
+	__m128 a = _mm_and_ps(r0, xyzMask);
+	__m128 b = _mm_and_ps(r1, xyzMask);
+	__m128 c = _mm_and_ps(r2, xyzMask);
+	__m128 const t = _mm_set_ps(0.0f, m[11], m[7], m[3]);
+
+	float const aa = _mm_cvtss_f32(Dot3(a, a));
+	float const bb = _mm_cvtss_f32(Dot3(b, b));
+	float const cc = _mm_cvtss_f32(Dot3(c, c));
+	float const ab = _mm_cvtss_f32(Dot3(a, b));
+	float const bc = _mm_cvtss_f32(Dot3(b, c));
+	float const ca = _mm_cvtss_f32(Dot3(c, a));
+
+	__m128 i0, i1, i2, i3;
+	if(IsRigid(aa, bb, cc, ab, bc, ca)) {
+		// rotation times uniform scale s, the inverse is the transpose over s^2
+		__m128 const invScale2 = _mm_set1_ps(1.0f / aa);
+		i0 = a;
+		i1 = b;
+		i2 = c;
+		i3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+		i0 = _mm_mul_ps(i0, invScale2);
+		i1 = _mm_mul_ps(i1, invScale2);
+		i2 = _mm_mul_ps(i2, invScale2);
+	} else {
+		// the columns of the inverse are the cross products of the rows over the determinant
+		i0 = Cross(b, c);
+		i1 = Cross(c, a);
+		i2 = Cross(a, b);
+		float const det = _mm_cvtss_f32(Dot3(a, i0));
+		__m128 const invDet = _mm_set1_ps(det != 0.0f ? 1.0f / det : 0.0f);
+		i3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+		i0 = _mm_mul_ps(i0, invDet);
+		i1 = _mm_mul_ps(i1, invDet);
+		i2 = _mm_mul_ps(i2, invDet);
+	}
+
+	// translation is -inverse * t, placed in the w lane of each row
+	__m128 const wMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	__m128 const negate = _mm_set1_ps(-0.0f);
+	i0 = _mm_or_ps(i0, _mm_and_ps(_mm_xor_ps(Dot3(i0, t), negate), wMask));
+	i1 = _mm_or_ps(i1, _mm_and_ps(_mm_xor_ps(Dot3(i1, t), negate), wMask));
+	i2 = _mm_or_ps(i2, _mm_and_ps(_mm_xor_ps(Dot3(i2, t), negate), wMask));
+
+	_mm_storeu_ps(out + 0, i0);
+	_mm_storeu_ps(out + 4, i1);
+	_mm_storeu_ps(out + 8, i2);
+	_mm_storeu_ps(out + 12, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+}
+#else
+inline void Transpose(float const* in, float* out) {
+	for(int r = 0; r < 4; ++r) {
+		for(int c = 0; c < 4; ++c) {
+			out[c * 4 + r] = in[r * 4 + c];
+		}
+	}
+}
+
+void InverseAffine(float const* m, float* out) {
+	float const* a = m + 0;
+	float const* b = m + 4;
+	float const* c = m + 8;
+	float const aa = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+	float const bb = b[0] * b[0] + b[1] * b[1] + b[2] * b[2];
+	float const cc = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+	float const ab = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	float const bc = b[0] * c[0] + b[1] * c[1] + b[2] * c[2];
+	float const ca = c[0] * a[0] + c[1] * a[1] + c[2] * a[2];
+
+	float inv[3][3];
+	if(IsRigid(aa, bb, cc, ab, bc, ca)) {
+		float const invScale2 = 1.0f / aa;
+		for(int r = 0; r < 3; ++r) {
+			for(int k = 0; k < 3; ++k) {
+				inv[r][k] = m[k * 4 + r] * invScale2;
+			}
+		}
+	} else {
+		float const x[3][3] = {
+				{ b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0] },
+				{ c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0] },
+				{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] },
+		};
+		float const det = a[0] * x[0][0] + a[1] * x[0][1] + a[2] * x[0][2];
+		float const invDet = det != 0.0f ? 1.0f / det : 0.0f;
+		for(int r = 0; r < 3; ++r) {
+			for(int k = 0; k < 3; ++k) {
+				inv[r][k] = x[k][r] * invDet;
+			}
+		}
+	}
+
+	for(int r = 0; r < 3; ++r) {
+		out[r * 4 + 0] = inv[r][0];
+		out[r * 4 + 1] = inv[r][1];
+		out[r * 4 + 2] = inv[r][2];
+		out[r * 4 + 3] = -(inv[r][0] * m[3] + inv[r][1] * m[7] + inv[r][2] * m[11]);
+	}
+	out[12] = 0.0f;
+	out[13] = 0.0f;
+	out[14] = 0.0f;
+	out[15] = 1.0f;
+}
+#endif
+
+} // end anonymous namespace
+
+void MeshModRender_ComputeLocalUniforms(Math_Mat4F const* localMatrices,
+		Math_Mat4F const* inverseLocalMatrices,
+		uint32_t count,
+		MeshModRender_LocalUniforms* uniforms) {
+	for(uint32_t i = 0; i < count; ++i) {
+		float const* local = localMatrices[i].v;
+		Transpose(local, uniforms[i].localToWorld.v);
+
+		// the inverse is uploaded as is, the shaders read that as the inverse transpose
+		float* inverse = uniforms[i].localToWorldTranspose.v;
+		if(inverseLocalMatrices) {
+			memcpy(inverse, inverseLocalMatrices[i].v, sizeof(Math_Mat4F));
+		} else if(IsAffine(local)) {
+			InverseAffine(local, inverse);
+		} else {
+			InverseGeneral(local, inverse);
+		}
+	}
+}
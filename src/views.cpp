@@ -0,0 +1,203 @@
+#include "al2o3_platform/platform.h"
+#include "render_meshmodrender/render.h"
+#include "render_basics/buffer.h"
+#include "render_basics/descriptorset.h"
+#include "render_basics/view.h"
+
+#include "meshrenderable.hpp"
+#include "manager.hpp"
+
+namespace {
+
+// bounds tests per job when culling a batch on the workers
+uint32_t const TestsPerJob = 256;
+
+struct ViewCullJob {
+	MeshModRender_Manager* manager;
+	Math_Mat4F const* localMatrices;
+	uint32_t count;
+};
+
+void ViewCullBatchJob(void* data, uint32_t jobIndex) {
+	auto job = (ViewCullJob const*) data;
+	MeshModRender_Manager* manager = job->manager;
+	MeshModRender_DrawData const& draws = manager->draws;
+
+	uint32_t const begin = jobIndex * TestsPerJob;
+	uint32_t const end = begin + TestsPerJob < job->count ? begin + TestsPerJob : job->count;
+	for(uint32_t i = begin; i < end; ++i) {
+		uint32_t const index = manager->batchIndices[i];
+		if(index == ~0u) {
+			manager->batchViewMasks[i] = 0;
+			continue;
+		}
+		uint32_t const mask = MeshModRender_ViewMaskForBounds(manager,
+				job->localMatrices[i],
+				draws.localBoundsMin[index],
+				draws.localBoundsMax[index]);
+		manager->batchViewMasks[i] = mask;
+		if(mask == 0) {
+			manager->batchIndices[i] = ~0u;
+		}
+	}
+}
+
+} // end anonymous namespace
+
+bool MeshModRender_ViewRingCreate(MeshModRender_Manager* manager) {
+	manager->viewCount = 1;
+	manager->viewSlotCount = (manager->framesInFlight + 1) * MeshModRender_ViewSetsPerFrame;
+
+	// the tail keeps the sets starting past the first view of the last slot in
+	// the buffer, the views they'd read there are never indexed
+	Render_BufferUniformDesc const ubDesc{
+			(uint32_t) (sizeof(MeshModRender_ViewUniforms) * manager->viewSlotCount +
+					sizeof(MeshModRender_ViewUniform) * (MMR_MAX_VIEWS - 1)),
+			true
+	};
+	manager->viewUniformBuffer = Render_BufferCreateUniform(manager->renderer, &ubDesc);
+	return Render_BufferHandleIsValid(manager->viewUniformBuffer);
+}
+
+Render_DescriptorSetHandle MeshModRender_ViewDescriptorSetCreate(MeshModRender_Manager* manager, Render_RootSignatureHandle rootSignature) {
+	Render_DescriptorSetDesc const setDesc = {
+			rootSignature,
+			Render_DUF_PER_FRAME,
+			manager->viewSlotCount * MMR_MAX_VIEWS
+	};
+
+	Render_DescriptorSetHandle descriptorSet = Render_DescriptorSetCreate(manager->renderer, &setDesc);
+	if (!Render_DescriptorSetHandleIsValid(descriptorSet)) {
+		return descriptorSet;
+	}
+	for(uint32_t slot = 0; slot < manager->viewSlotCount; ++slot) {
+		for(uint32_t firstView = 0; firstView < MMR_MAX_VIEWS; ++firstView) {
+			Render_DescriptorDesc params[1];
+			params[0].name = "View";
+			params[0].type = Render_DT_BUFFER;
+			params[0].buffer = manager->viewUniformBuffer;
+			params[0].offset = slot * sizeof(MeshModRender_ViewUniforms) + firstView * sizeof(MeshModRender_ViewUniform);
+			params[0].size = sizeof(MeshModRender_ViewUniforms);
+			Render_DescriptorPresetFrequencyUpdated(descriptorSet, MeshModRender_ViewSetIndex(slot, firstView), 1, params);
+		}
+	}
+	return descriptorSet;
+}
+
+uint32_t MeshModRender_ViewMaskForBounds(MeshModRender_Manager* manager,
+		Math_Mat4F const& localMatrix,
+		Math_Vec3F const& boundsMin,
+		Math_Vec3F const& boundsMax) {
+	float const* l = localMatrix.v;
+	uint32_t mask = 0;
+
+	for(uint32_t view = 0; view < manager->viewCount; ++view) {
+		float const* w = manager->viewWorldToClip[view].v;
+
+		// outside if every corner is beyond the same plane, near and far are left
+		// out so this stays conservative for either depth direction
+		uint32_t allOutside = 0x1F;
+		for(uint32_t i = 0; i < 8 && allOutside; ++i) {
+			float const cx = (i & 1) ? boundsMax.x : boundsMin.x;
+			float const cy = (i & 2) ? boundsMax.y : boundsMin.y;
+			float const cz = (i & 4) ? boundsMax.z : boundsMin.z;
+			float const wx = l[0] * cx + l[1] * cy + l[2] * cz + l[3];
+			float const wy = l[4] * cx + l[5] * cy + l[6] * cz + l[7];
+			float const wz = l[8] * cx + l[9] * cy + l[10] * cz + l[11];
+			float const x = w[0] * wx + w[1] * wy + w[2] * wz + w[3];
+			float const y = w[4] * wx + w[5] * wy + w[6] * wz + w[7];
+			float const clipW = w[12] * wx + w[13] * wy + w[14] * wz + w[15];
+
+			uint32_t outside = 0;
+			outside |= (x < -clipW) ? 0x1 : 0;
+			outside |= (x > clipW) ? 0x2 : 0;
+			outside |= (y < -clipW) ? 0x4 : 0;
+			outside |= (y > clipW) ? 0x8 : 0;
+			outside |= (clipW <= 0.0f) ? 0x10 : 0;
+			allOutside &= outside;
+		}
+		if(!allOutside) {
+			mask |= 1u << view;
+		}
+	}
+	return mask;
+}
+
+bool MeshModRender_ViewCullBatch(MeshModRender_Manager* manager, uint32_t count, Math_Mat4F const* localMatrices) {
+	manager->batchViewMasks = (uint32_t*) MeshModRender_ScratchAlloc(manager->scratch, count * sizeof(uint32_t));
+	if(!manager->batchViewMasks) {
+		return false;
+	}
+
+	ViewCullJob job = {
+			manager,
+			localMatrices,
+			count
+	};
+	MeshModRender_WorkersParallelFor(manager->workers, (count + TestsPerJob - 1) / TestsPerJob, &ViewCullBatchJob, &job);
+	return true;
+}
+
+AL2O3_EXTERN_C void MeshModRender_ManagerSetViews(MeshModRender_Manager* manager, uint32_t count, Render_GpuView const* views) {
+	if(count == 0) {
+		return;
+	}
+	uint32_t const maxViews = manager->multiView ? MMR_MAX_VIEWS : 1;
+	if(count > maxViews) {
+		LOGWARNING("MeshModRender %u views clamped to %u", count, maxViews);
+		count = maxViews;
+	}
+
+	MeshModRender_ViewUniforms uniforms;
+	memset(&uniforms, 0, sizeof(MeshModRender_ViewUniforms));
+	for(uint32_t i = 0; i < count; ++i) {
+		manager->views[i] = views[i];
+		uniforms.views[i].worldToViewMatrix = views[i].worldToViewMatrix;
+		uniforms.views[i].viewToNDCMatrix = views[i].viewToNDCMatrix;
+		uniforms.views[i].worldToNDCMatrix = views[i].worldToNDCMatrix;
+		uniforms.views[i].viewIndex = i;
+		// view matrices are column major, culling wants rows
+		manager->viewWorldToClip[i] = Math_TransposeMat4F(views[i].worldToNDCMatrix);
+	}
+	manager->viewCount = count;
+
+	// a fresh slot from this frames share of the ring, so anything encoded with the
+	// old views still sees them. The other frames slots may still be in flight
+	if(manager->viewSetsThisFrame >= MeshModRender_ViewSetsPerFrame && !manager->viewRingOverflowWarned) {
+		LOGWARNING("MeshModRender more than %u view changes this frame, earlier draws may see later views",
+				MeshModRender_ViewSetsPerFrame);
+		manager->viewRingOverflowWarned = true;
+	}
+	uint32_t const frameBase = (uint32_t) (manager->frameIndex % (manager->framesInFlight + 1)) * MeshModRender_ViewSetsPerFrame;
+	manager->viewSlot = frameBase + manager->viewSetsThisFrame % MeshModRender_ViewSetsPerFrame;
+	manager->viewSetsThisFrame++;
+	Render_BufferUpdateDesc uniformUpdate = {
+			&uniforms,
+			manager->viewSlot * sizeof(MeshModRender_ViewUniforms),
+			sizeof(MeshModRender_ViewUniforms)
+	};
+	Render_BufferUpload(manager->viewUniformBuffer, &uniformUpdate);
+
+	// the occluders were rasterised for the old view
+	if(manager->occlusion) {
+		MeshModRender_OcclusionBufferInvalidate(manager->occlusion);
+	}
+}
+
+AL2O3_EXTERN_C void MeshModRender_ManagerSetView(MeshModRender_Manager* manager, Render_GpuView* view) {
+	MeshModRender_ManagerSetViews(manager, 1, view);
+}
+
+AL2O3_EXTERN_C uint32_t MeshModRender_MeshGetViewMask(MeshModRender_Manager* manager,
+		MeshModRender_MeshHandle mrhandle,
+		Math_Mat4F localMatrix) {
+	auto mesh = MeshModRender_LookupMesh(manager, mrhandle.handle);
+	if(mesh->drawIndex == ~0u) {
+		return 0;
+	}
+	MeshModRender_DrawData const& draws = manager->draws;
+	return MeshModRender_ViewMaskForBounds(manager,
+			localMatrix,
+			draws.localBoundsMin[mesh->drawIndex],
+			draws.localBoundsMax[mesh->drawIndex]);
+}
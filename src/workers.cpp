@@ -0,0 +1,232 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_memory/memory.h"
+#include "al2o3_thread/thread.h"
+#include "al2o3_cadt/vector.h"
+
+#include "workers.hpp"
+
+struct MeshModRender_Job {
+	MeshModRender_JobFunc func;
+	void* data;
+	uint32_t index;
+	// decremented under the pool lock when the job finishes
+	uint32_t* remaining;
+};
+
+// FIFO of jobs, popped from head and emptied when it catches up
+struct MeshModRender_JobQueue {
+	CADT_VectorHandle jobs;
+	size_t head;
+};
+
+struct MeshModRender_Workers {
+	Thread_Mutex lock;
+	// signalled when jobs are queued or the pool is quitting
+	Thread_ConditionalVariable wake;
+	// signalled when a counted job finishes
+	Thread_ConditionalVariable done;
+
+	// parallel for jobs, always taken first
+	MeshModRender_JobQueue jobs;
+	// submitted jobs, only taken by idle workers
+	MeshModRender_JobQueue background;
+	bool quit;
+
+	uint32_t threadCount;
+	Thread_Thread* threads;
+};
+
+// must hold the lock
+static bool PopJob(MeshModRender_JobQueue& queue, MeshModRender_Job& job) {
+	if(queue.head == CADT_VectorSize(queue.jobs)) {
+		return false;
+	}
+	job = *(MeshModRender_Job*) CADT_VectorAt(queue.jobs, queue.head++);
+	if(queue.head == CADT_VectorSize(queue.jobs)) {
+		CADT_VectorResize(queue.jobs, 0);
+		queue.head = 0;
+	}
+	return true;
+}
+
+// must hold the lock, removes the first queued job counted by remaining
+static bool PopJobFor(MeshModRender_JobQueue& queue, uint32_t const* remaining, MeshModRender_Job& job) {
+	size_t const size = CADT_VectorSize(queue.jobs);
+	for(size_t i = queue.head; i < size; ++i) {
+		auto candidate = (MeshModRender_Job*) CADT_VectorAt(queue.jobs, i);
+		if(candidate->remaining != remaining) {
+			continue;
+		}
+		job = *candidate;
+		// shuffle the earlier jobs up a place to keep the order
+		if(i != queue.head) {
+			memmove(CADT_VectorAt(queue.jobs, queue.head + 1),
+					CADT_VectorAt(queue.jobs, queue.head),
+					(i - queue.head) * sizeof(MeshModRender_Job));
+		}
+		queue.head++;
+		if(queue.head == size) {
+			CADT_VectorResize(queue.jobs, 0);
+			queue.head = 0;
+		}
+		return true;
+	}
+	return false;
+}
+
+// runs with the lock dropped, returns with it held
+static void RunJob(MeshModRender_Workers* workers, MeshModRender_Job const& job) {
+	Thread_MutexRelease(&workers->lock);
+	job.func(job.data, job.index);
+	Thread_MutexAcquire(&workers->lock);
+
+	if(job.remaining && --(*job.remaining) == 0) {
+		Thread_CondVarWakeAll(&workers->done);
+	}
+}
+
+// must hold the lock, help out rather than sit idle. Only jobs counted by
+// remaining are taken, another callers jobs may be part of a long background build
+static void HelpUntilDone(MeshModRender_Workers* workers, uint32_t const* remaining) {
+	while(*remaining) {
+		MeshModRender_Job job;
+		if(PopJobFor(workers->jobs, remaining, job) || PopJobFor(workers->background, remaining, job)) {
+			RunJob(workers, job);
+		} else {
+			Thread_CondVarWait(&workers->done, &workers->lock, ~0ull);
+		}
+	}
+}
+
+static void WorkerThread(void* data) {
+	auto workers = (MeshModRender_Workers*) data;
+
+	Thread_MutexAcquire(&workers->lock);
+	while(true) {
+		MeshModRender_Job job;
+		if(PopJob(workers->jobs, job) || PopJob(workers->background, job)) {
+			RunJob(workers, job);
+			continue;
+		}
+		if(workers->quit) {
+			break;
+		}
+		Thread_CondVarWait(&workers->wake, &workers->lock, ~0ull);
+	}
+	Thread_MutexRelease(&workers->lock);
+}
+
+MeshModRender_Workers* MeshModRender_WorkersCreate(uint32_t threadCount) {
+	if(threadCount == 0) {
+		return nullptr;
+	}
+
+	auto workers = (MeshModRender_Workers*) MEMORY_CALLOC(1, sizeof(MeshModRender_Workers));
+	if(!workers) {
+		return nullptr;
+	}
+	Thread_MutexCreate(&workers->lock);
+	Thread_CondVarCreate(&workers->wake);
+	Thread_CondVarCreate(&workers->done);
+	workers->jobs.jobs = CADT_VectorCreate(sizeof(MeshModRender_Job));
+	workers->background.jobs = CADT_VectorCreate(sizeof(MeshModRender_Job));
+
+	workers->threads = (Thread_Thread*) MEMORY_CALLOC(threadCount, sizeof(Thread_Thread));
+	for(uint32_t i = 0; i < threadCount; ++i) {
+		if(!Thread_ThreadCreate(&workers->threads[i], &WorkerThread, workers)) {
+			break;
+		}
+		workers->threadCount++;
+	}
+
+	return workers;
+}
+
+void MeshModRender_WorkersDestroy(MeshModRender_Workers* workers) {
+	if(!workers) {
+		return;
+	}
+
+	Thread_MutexAcquire(&workers->lock);
+	workers->quit = true;
+	Thread_CondVarWakeAll(&workers->wake);
+	Thread_MutexRelease(&workers->lock);
+
+	for(uint32_t i = 0; i < workers->threadCount; ++i) {
+		Thread_ThreadJoin(&workers->threads[i]);
+		Thread_ThreadDestroy(&workers->threads[i]);
+	}
+	MEMORY_FREE(workers->threads);
+
+	CADT_VectorDestroy(workers->background.jobs);
+	CADT_VectorDestroy(workers->jobs.jobs);
+	Thread_CondVarDestroy(&workers->done);
+	Thread_CondVarDestroy(&workers->wake);
+	Thread_MutexDestroy(&workers->lock);
+	MEMORY_FREE(workers);
+}
+
+uint32_t MeshModRender_WorkersThreadCount(MeshModRender_Workers* workers) {
+	return workers ? workers->threadCount : 0;
+}
+
+void MeshModRender_WorkersParallelFor(MeshModRender_Workers* workers, uint32_t count, MeshModRender_JobFunc func, void* data) {
+	if(count == 0) {
+		return;
+	}
+
+	if(!workers || workers->threadCount == 0 || count == 1) {
+		for(uint32_t i = 0; i < count; ++i) {
+			func(data, i);
+		}
+		return;
+	}
+
+	uint32_t remaining = count;
+
+	Thread_MutexAcquire(&workers->lock);
+	for(uint32_t i = 0; i < count; ++i) {
+		MeshModRender_Job const job = { func, data, i, &remaining };
+		CADT_VectorPushElement(workers->jobs.jobs, &job);
+	}
+	Thread_CondVarWakeAll(&workers->wake);
+	HelpUntilDone(workers, &remaining);
+	Thread_MutexRelease(&workers->lock);
+}
+
+void MeshModRender_WorkersSubmit(MeshModRender_Workers* workers, MeshModRender_JobFunc func, void* data, uint32_t index, uint32_t* remaining) {
+	if(!workers || workers->threadCount == 0) {
+		func(data, index);
+		if(remaining) {
+			--(*remaining);
+		}
+		return;
+	}
+
+	Thread_MutexAcquire(&workers->lock);
+	MeshModRender_Job const job = { func, data, index, remaining };
+	CADT_VectorPushElement(workers->background.jobs, &job);
+	Thread_CondVarWakeOne(&workers->wake);
+	Thread_MutexRelease(&workers->lock);
+}
+
+bool MeshModRender_WorkersIsDone(MeshModRender_Workers* workers, uint32_t const* remaining) {
+	if(!workers || workers->threadCount == 0) {
+		return *remaining == 0;
+	}
+
+	Thread_MutexAcquire(&workers->lock);
+	bool const done = *remaining == 0;
+	Thread_MutexRelease(&workers->lock);
+	return done;
+}
+
+void MeshModRender_WorkersWait(MeshModRender_Workers* workers, uint32_t const* remaining) {
+	if(!workers || workers->threadCount == 0) {
+		return;
+	}
+
+	Thread_MutexAcquire(&workers->lock);
+	HelpUntilDone(workers, remaining);
+	Thread_MutexRelease(&workers->lock);
+}
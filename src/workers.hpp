@@ -0,0 +1,28 @@
+#pragma once
+
+#include "al2o3_platform/platform.h"
+
+// a small fixed pool of worker threads shared by everything the manager does in parallel
+struct MeshModRender_Workers;
+
+typedef void (*MeshModRender_JobFunc)(void* data, uint32_t index);
+
+// threadCount 0 gives a null pool, all work then runs on the calling thread
+MeshModRender_Workers* MeshModRender_WorkersCreate(uint32_t threadCount);
+void MeshModRender_WorkersDestroy(MeshModRender_Workers* workers);
+uint32_t MeshModRender_WorkersThreadCount(MeshModRender_Workers* workers);
+
+// runs func(data, i) for every i in [0, count), the calling thread helps out with
+// these jobs only and returns once all have finished
+void MeshModRender_WorkersParallelFor(MeshModRender_Workers* workers, uint32_t count, MeshModRender_JobFunc func, void* data);
+
+// queues func(data, index) as a background job and returns straight away.
+// remaining is decremented under the pool lock when it finishes, so one counter
+// can track several jobs. Workers only take background jobs when no parallel for
+// jobs are queued and threads helping out in a parallel for never run them, so a
+// long job can't stall the frame. Without a pool the job runs before this returns
+void MeshModRender_WorkersSubmit(MeshModRender_Workers* workers, MeshModRender_JobFunc func, void* data, uint32_t index, uint32_t* remaining);
+// true once remaining has reached 0, never blocks
+bool MeshModRender_WorkersIsDone(MeshModRender_Workers* workers, uint32_t const* remaining);
+// helps run the jobs counted by remaining until it reaches 0
+void MeshModRender_WorkersWait(MeshModRender_Workers* workers, uint32_t const* remaining);
@@ -0,0 +1,143 @@
+#include "al2o3_catch2/catch2.hpp"
+#include "al2o3_memory/memory.h"
+
+#include "../src/allocators.hpp"
+
+TEST_CASE("Scratch rewinds to a mark including spills", "[MeshModRender Allocators]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_Scratch scratch;
+	REQUIRE(MeshModRender_ScratchCreate(scratch, &heap, 256));
+
+	void* first = MeshModRender_ScratchAlloc(scratch, 64);
+	REQUIRE(first);
+	CHECK(((uintptr_t) first & 15) == 0);
+	MeshModRender_ScratchMark const mark = MeshModRender_ScratchGetMark(scratch);
+	uint64_t const heapLive = Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes);
+
+	void* inBlock = MeshModRender_ScratchAlloc(scratch, 100);
+	REQUIRE(inBlock);
+	CHECK(((uintptr_t) inBlock & 15) == 0);
+	CHECK(scratch.overflow == nullptr);
+	// doesn't fit the rest of the block
+	void* spilled = MeshModRender_ScratchAlloc(scratch, 1024);
+	REQUIRE(spilled);
+	CHECK(((uintptr_t) spilled & 15) == 0);
+	CHECK(scratch.overflow != nullptr);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) > heapLive);
+
+	MeshModRender_ScratchRewind(scratch, mark);
+	CHECK(scratch.offset == 64);
+	CHECK(scratch.overflow == nullptr);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == heapLive);
+	CHECK(Thread_AtomicLoad64Relaxed(&scratch.counters.liveBytes) == 64);
+	CHECK(Thread_AtomicLoad64Relaxed(&scratch.counters.liveAllocations) == 1);
+	// the next allocation reuses the rewound space
+	CHECK(MeshModRender_ScratchAlloc(scratch, 100) == inBlock);
+
+	// once empty the block grows to cover what spilled
+	MeshModRender_ScratchReset(scratch);
+	CHECK(scratch.capacity >= 256 + 1024);
+	CHECK(Thread_AtomicLoad64Relaxed(&scratch.counters.liveBytes) == 0);
+	MeshModRender_ScratchAlloc(scratch, 64);
+	MeshModRender_ScratchAlloc(scratch, 100);
+	MeshModRender_ScratchAlloc(scratch, 1024);
+	CHECK(scratch.overflow == nullptr);
+
+	MeshModRender_ScratchDestroy(scratch);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+}
+
+TEST_CASE("Pool reuses freed blocks of the same size class", "[MeshModRender Allocators]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_Pool pool;
+	REQUIRE(MeshModRender_PoolCreate(pool, &heap));
+
+	void* block = MeshModRender_PoolAlloc(pool, 100);
+	REQUIRE(block);
+	CHECK(((uintptr_t) block & 15) == 0);
+	MeshModRender_PoolFree(pool, block);
+	uint64_t const heapAllocations = Thread_AtomicLoad64Relaxed(&heap.counters.totalAllocations);
+
+	CHECK(MeshModRender_PoolAlloc(pool, 90) == block);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.totalAllocations) == heapAllocations);
+	// a different class never gets it
+	void* larger = MeshModRender_PoolAlloc(pool, 1000);
+	CHECK(larger != block);
+	CHECK(Thread_AtomicLoad64Relaxed(&pool.counters.liveAllocations) == 2);
+
+	MeshModRender_PoolFree(pool, block);
+	MeshModRender_PoolFree(pool, larger);
+	CHECK(Thread_AtomicLoad64Relaxed(&pool.counters.liveBytes) == 0);
+	MeshModRender_PoolDestroy(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+}
+
+TEST_CASE("Pool trim returns blocks unused since the last trim", "[MeshModRender Allocators]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_Pool pool;
+	REQUIRE(MeshModRender_PoolCreate(pool, &heap));
+
+	void* block = MeshModRender_PoolAlloc(pool, 100);
+	MeshModRender_PoolFree(pool, block);
+	uint64_t const heapLive = Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes);
+	REQUIRE(heapLive > 0);
+
+	// freed since the last trim, so it stays one more period
+	MeshModRender_PoolTrim(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == heapLive);
+
+	// taken and returned before the next trim, so it was needed and is kept
+	CHECK(MeshModRender_PoolAlloc(pool, 100) == block);
+	MeshModRender_PoolFree(pool, block);
+	MeshModRender_PoolTrim(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == heapLive);
+
+	// sat on the free list for a whole period
+	MeshModRender_PoolTrim(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+
+	MeshModRender_PoolDestroy(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+}
+
+TEST_CASE("Pool arrays only reallocate when they outgrow their class", "[MeshModRender Allocators]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_Pool pool;
+	REQUIRE(MeshModRender_PoolCreate(pool, &heap));
+
+	MeshModRender_PoolArray array = {};
+	REQUIRE(MeshModRender_PoolArrayResize(pool, array, 12, 10));
+	CHECK(array.count == 10);
+	CHECK(array.elementSize == 12);
+	CHECK(array.capacityBytes >= 120);
+	void* const data = array.data;
+
+	REQUIRE(MeshModRender_PoolArrayResize(pool, array, 12, 5));
+	CHECK(array.data == data);
+	REQUIRE(MeshModRender_PoolArrayResize(pool, array, 4, (uint32_t) (array.capacityBytes / 4)));
+	CHECK(array.data == data);
+	REQUIRE(MeshModRender_PoolArrayResize(pool, array, 12, 1000));
+	CHECK(array.count == 1000);
+	CHECK(array.capacityBytes >= 12000);
+
+	MeshModRender_PoolArrayFree(pool, array);
+	CHECK(array.data == nullptr);
+	CHECK(array.count == 0);
+	CHECK(Thread_AtomicLoad64Relaxed(&pool.counters.liveBytes) == 0);
+	MeshModRender_PoolDestroy(pool);
+}
+
+TEST_CASE("Allocator counters track the peak", "[MeshModRender Allocators]") {
+	MeshModRender_AllocatorCounters counters = {};
+	MeshModRender_CountersAdd(counters, 100);
+	MeshModRender_CountersAdd(counters, 50);
+	MeshModRender_CountersRemove(counters, 100);
+	MeshModRender_CountersAdd(counters, 20);
+
+	MeshModRender_AllocatorStats stats;
+	MeshModRender_CountersGet(counters, stats);
+	CHECK(stats.liveBytes == 70);
+	CHECK(stats.peakBytes == 150);
+	CHECK(stats.liveAllocations == 2);
+	CHECK(stats.totalAllocations == 3);
+}
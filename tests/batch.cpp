@@ -0,0 +1,113 @@
+#include "al2o3_catch2/catch2.hpp"
+#include "al2o3_memory/memory.h"
+
+#include "../src/manager.hpp"
+#include <algorithm>
+
+namespace {
+
+Math_Mat4F Translation(float x, float y, float z) {
+	// row major like the local matrices given to the manager
+	Math_Mat4F m = {};
+	m.v[0] = m.v[5] = m.v[10] = m.v[15] = 1.0f;
+	m.v[3] = x;
+	m.v[7] = y;
+	m.v[11] = z;
+	return m;
+}
+
+// 90 degree fov looking down +z (left handed) or -z, column major as uploaded
+Math_Mat4F Perspective(bool leftHanded) {
+	float const nearZ = 0.1f;
+	float const farZ = 100.0f;
+	float const sign = leftHanded ? 1.0f : -1.0f;
+	Math_Mat4F m = {};
+	m.v[0] = 1.0f;
+	m.v[5] = 1.0f;
+	m.v[10] = sign * farZ / (farZ - nearZ);
+	m.v[11] = sign;
+	m.v[14] = -nearZ * farZ / (farZ - nearZ);
+	return m;
+}
+
+} // end anonymous namespace
+
+TEST_CASE("Radix sort matches a stable sort on the top 32 bits", "[MeshModRender Batch]") {
+	uint32_t const count = 1000;
+	static uint64_t keys[count];
+	static uint64_t temp[count];
+	static uint64_t expected[count];
+
+	// the top byte is shared by every key so that pass is skipped, leaving an odd
+	// number of passes. The low 32 bits are out of order to show they don't take part
+	uint32_t state = 7;
+	for(uint32_t i = 0; i < count; ++i) {
+		state = state * 1664525u + 1013904223u;
+		uint64_t const high = 0x5A000000u | (state >> 8);
+		keys[i] = (high << 32) | (count - i);
+		expected[i] = keys[i];
+	}
+	std::stable_sort(expected, expected + count, [](uint64_t a, uint64_t b) {
+		return (a >> 32) < (b >> 32);
+	});
+
+	uint64_t const* sorted = MeshModRender_RadixSortKeys(keys, temp, count);
+	CHECK(sorted == temp);
+	CHECK(memcmp(sorted, expected, sizeof(expected)) == 0);
+
+	// every key the same sorts in place
+	for(uint32_t i = 0; i < count; ++i) {
+		keys[i] = (42ull << 32) | i;
+	}
+	sorted = MeshModRender_RadixSortKeys(keys, temp, count);
+	REQUIRE(sorted == keys);
+	for(uint32_t i = 0; i < count; ++i) {
+		CHECK(sorted[i] == ((42ull << 32) | i));
+	}
+}
+
+TEST_CASE("Sort keys group by material then front to back", "[MeshModRender Batch]") {
+	auto manager = (MeshModRender_Manager*) MEMORY_CALLOC(1, sizeof(MeshModRender_Manager));
+	REQUIRE(manager);
+	manager->heap.allocator = &Memory_GlobalAllocator;
+	REQUIRE(MeshModRender_ScratchCreate(manager->scratch, &manager->heap, 4096));
+
+	// draws 0 and 1 share a material, 2 and 3 share another
+	MeshModRender_RenderStyle renderStyle[4] = { MMR_RS_FACE_COLOURS, MMR_RS_TRIANGLE_COLOURS, MMR_RS_NORMAL, MMR_RS_NORMAL };
+	Math_Vec3F boundsMin[4], boundsMax[4];
+	for(uint32_t i = 0; i < 4; ++i) {
+		boundsMin[i] = { -1.0f, -1.0f, -1.0f };
+		boundsMax[i] = { 1.0f, 1.0f, 1.0f };
+	}
+	manager->draws.renderStyle = renderStyle;
+	manager->draws.localBoundsMin = boundsMin;
+	manager->draws.localBoundsMax = boundsMax;
+	manager->styleMaterial[MMR_RS_NORMAL].sortId = 1;
+	manager->views[0].worldToViewMatrix = Translation(0, 0, 0);
+
+	for(int leftHanded = 0; leftHanded < 2; ++leftHanded) {
+		float const forward = leftHanded ? 1.0f : -1.0f;
+		manager->views[0].viewToNDCMatrix = Perspective(leftHanded != 0);
+
+		// the last entry is a skipped draw, which always goes last
+		uint32_t batchIndices[5] = { 0, 1, 2, 3, ~0u };
+		Math_Mat4F const localMatrices[5] = {
+				Translation(0, 0, 10.0f * forward),
+				Translation(0, 0, 5.0f * forward),
+				Translation(0, 0, 20.0f * forward),
+				Translation(0, 0, 2.0f * forward),
+				Translation(0, 0, 0),
+		};
+		manager->batchIndices = batchIndices;
+
+		MeshModRender_ScratchMark const mark = MeshModRender_ScratchGetMark(manager->scratch);
+		REQUIRE(MeshModRender_BuildFrontToBackOrder(manager, 5, localMatrices));
+		uint32_t const expected[5] = { 1, 0, 3, 2, 4 };
+		CHECK(memcmp(manager->batchOrder, expected, sizeof(expected)) == 0);
+		MeshModRender_ScratchRewind(manager->scratch, mark);
+	}
+
+	MeshModRender_ScratchDestroy(manager->scratch);
+	CHECK(Thread_AtomicLoad64Relaxed(&manager->heap.counters.liveBytes) == 0);
+	MEMORY_FREE(manager);
+}
@@ -0,0 +1,153 @@
+#include "al2o3_catch2/catch2.hpp"
+#include "al2o3_memory/memory.h"
+
+#include "../src/allocators.hpp"
+#include "../src/bvh.hpp"
+#include <math.h>
+
+namespace {
+
+uint32_t const TriangleCount = 300;
+uint32_t const RayCount = 500;
+
+struct Random {
+	uint32_t state;
+
+	// [lo, hi)
+	float Next(float lo, float hi) {
+		state = state * 1664525u + 1013904223u;
+		return lo + (hi - lo) * (float) (state >> 8) / 16777216.0f;
+	}
+};
+
+void RandomTriangles(Random& random, Math_Vec3F* positions) {
+	for (uint32_t i = 0; i < TriangleCount; ++i) {
+		Math_Vec3F const centre = { random.Next(-10.0f, 10.0f), random.Next(-10.0f, 10.0f), random.Next(-10.0f, 10.0f) };
+		for (uint32_t j = 0; j < 3; ++j) {
+			positions[i * 3 + j] = {
+					centre.x + random.Next(-1.5f, 1.5f),
+					centre.y + random.Next(-1.5f, 1.5f),
+					centre.z + random.Next(-1.5f, 1.5f)
+			};
+		}
+	}
+}
+
+// every triangle tested the same way the bvh tests its leaves
+bool BruteForceIntersect(Math_Vec3F const* positions,
+		Math_Vec3F const& origin,
+		Math_Vec3F const& dir,
+		float maxT,
+		float& hitT,
+		uint32_t& hitTriangle) {
+	bool hit = false;
+	hitT = maxT;
+	for (uint32_t i = 0; i < TriangleCount; ++i) {
+		Math_Vec3F const v0 = positions[i * 3 + 0];
+		float const e1[3] = { positions[i * 3 + 1].x - v0.x, positions[i * 3 + 1].y - v0.y, positions[i * 3 + 1].z - v0.z };
+		float const e2[3] = { positions[i * 3 + 2].x - v0.x, positions[i * 3 + 2].y - v0.y, positions[i * 3 + 2].z - v0.z };
+		float const p[3] = { dir.y * e2[2] - dir.z * e2[1], dir.z * e2[0] - dir.x * e2[2], dir.x * e2[1] - dir.y * e2[0] };
+		float const det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		if (fabsf(det) <= 1e-12f) {
+			continue;
+		}
+		float const invDet = 1.0f / det;
+		float const s[3] = { origin.x - v0.x, origin.y - v0.y, origin.z - v0.z };
+		float const u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+		float const q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		float const v = (dir.x * q[0] + dir.y * q[1] + dir.z * q[2]) * invDet;
+		float const t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < hitT) {
+			hit = true;
+			hitT = t;
+			hitTriangle = i;
+		}
+	}
+	return hit;
+}
+
+// rays from a sphere around the soup aimed at its middle, returns how many disagree
+uint32_t CountMismatches(MeshModRender_Bvh const* bvh, Math_Vec3F const* positions, uint32_t seed) {
+	Random random = { seed };
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < RayCount; ++i) {
+		Math_Vec3F const origin = { random.Next(-30.0f, 30.0f), random.Next(-30.0f, 30.0f), random.Next(-30.0f, 30.0f) };
+		Math_Vec3F const target = { random.Next(-8.0f, 8.0f), random.Next(-8.0f, 8.0f), random.Next(-8.0f, 8.0f) };
+		Math_Vec3F dir = { target.x - origin.x, target.y - origin.y, target.z - origin.z };
+		float const length = sqrtf(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+		dir = { dir.x / length, dir.y / length, dir.z / length };
+
+		float bvhT = 0.0f, bruteT = 0.0f;
+		uint32_t bvhTriangle = ~0u, bruteTriangle = ~0u;
+		bool const bvhHit = MeshModRender_BvhIntersect(bvh, origin, dir, 1000.0f, bvhT, bvhTriangle);
+		bool const bruteHit = BruteForceIntersect(positions, origin, dir, 1000.0f, bruteT, bruteTriangle);
+		if (bvhHit != bruteHit) {
+			mismatches++;
+		} else if (bvhHit && (fabsf(bvhT - bruteT) > 1e-4f * bruteT ||
+				(bvhTriangle != bruteTriangle && bvhT != bruteT))) {
+			// a different triangle is only right if it is hit at the same distance
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+} // end anonymous namespace
+
+TEST_CASE("Bvh intersections match brute force", "[MeshModRender Bvh]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_Pool pool;
+	REQUIRE(MeshModRender_PoolCreate(pool, &heap));
+
+	static Math_Vec3F positions[TriangleCount * 3];
+	Random random = { 1 };
+	RandomTriangles(random, positions);
+
+	MeshModRender_Bvh* bvh = MeshModRender_BvhCreate(nullptr, &pool, positions, TriangleCount);
+	REQUIRE(bvh);
+	CHECK(CountMismatches(bvh, positions, 2) == 0);
+
+	// nothing past maxT
+	float t;
+	uint32_t triangle;
+	CHECK_FALSE(MeshModRender_BvhIntersect(bvh, { 0.0f, 0.0f, -100.0f }, { 0.0f, 0.0f, 1.0f }, 10.0f, t, triangle));
+
+	MeshModRender_BvhDestroy(bvh);
+	MeshModRender_PoolDestroy(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+}
+
+TEST_CASE("Bvh refits and clones stay independent", "[MeshModRender Bvh]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_Pool pool;
+	REQUIRE(MeshModRender_PoolCreate(pool, &heap));
+
+	static Math_Vec3F positions[TriangleCount * 3];
+	static Math_Vec3F moved[TriangleCount * 3];
+	Random random = { 3 };
+	RandomTriangles(random, positions);
+	// same triangles in the same order, shifted and jittered so the old bounds are wrong
+	for (uint32_t i = 0; i < TriangleCount * 3; ++i) {
+		moved[i] = {
+				positions[i].x * 0.5f + 2.0f + random.Next(-0.5f, 0.5f),
+				positions[i].y * 1.2f + random.Next(-0.5f, 0.5f),
+				positions[i].z - 1.0f + random.Next(-0.5f, 0.5f)
+		};
+	}
+
+	MeshModRender_Bvh* bvh = MeshModRender_BvhCreate(nullptr, &pool, positions, TriangleCount);
+	REQUIRE(bvh);
+	MeshModRender_Bvh* clone = MeshModRender_BvhClone(bvh);
+	REQUIRE(clone);
+
+	CHECK_FALSE(MeshModRender_BvhRefit(bvh, moved, TriangleCount - 1));
+	REQUIRE(MeshModRender_BvhRefit(bvh, moved, TriangleCount));
+	CHECK(CountMismatches(bvh, moved, 4) == 0);
+	// the clone still has the original positions
+	CHECK(CountMismatches(clone, positions, 5) == 0);
+
+	MeshModRender_BvhDestroy(clone);
+	MeshModRender_BvhDestroy(bvh);
+	MeshModRender_PoolDestroy(pool);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+}
@@ -0,0 +1,161 @@
+#include "al2o3_catch2/catch2.hpp"
+
+#include "../src/cache.hpp"
+#include <stdio.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+char const* const CacheDirectory = "meshmodrender_cache_test";
+uint32_t const VertexSize = 16;
+uint32_t const VertexCount = 10;
+// the 80 byte file header and the vertices
+uint64_t const EntryBytes = 80 + VertexCount * VertexSize;
+uint64_t const KeyCount = 8;
+
+MeshModRender_CacheKey Key(uint64_t id) {
+	return { id, 2, 3, 0, VertexSize };
+}
+
+// starts every test from an empty directory
+void ClearDirectory() {
+#if defined(_WIN32)
+	_mkdir(CacheDirectory);
+#else
+	mkdir(CacheDirectory, 0755);
+#endif
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/index.mmri", CacheDirectory);
+	remove(path);
+	snprintf(path, sizeof(path), "%s/index.mmrj", CacheDirectory);
+	remove(path);
+	for (uint64_t id = 1; id <= KeyCount; ++id) {
+		MeshModRender_CacheKey const key = Key(id);
+		snprintf(path, sizeof(path), "%s/%016llx%016llx%016llx_%u_%u.mmrc",
+				CacheDirectory,
+				(unsigned long long) key.posHash,
+				(unsigned long long) key.normalHash,
+				(unsigned long long) key.topologyHash,
+				key.style,
+				key.vertexSize);
+		remove(path);
+	}
+}
+
+// every byte of the vertices is the low byte of the id
+bool Put(MeshModRender_Cache* cache, uint64_t id) {
+	MeshModRender_CacheWriter writer;
+	if (!MeshModRender_CacheBeginWrite(cache, Key(id), VertexCount, writer)) {
+		return false;
+	}
+	uint8_t vertices[VertexCount * VertexSize];
+	memset(vertices, (int) id, sizeof(vertices));
+	MeshModRender_CacheWrite(writer, vertices, sizeof(vertices));
+	MeshModRender_CacheEndWrite(cache, writer, { -1.0f, -2.0f, -3.0f }, { 1.0f, 2.0f, (float) id });
+	return true;
+}
+
+bool Has(MeshModRender_Cache* cache, uint64_t id) {
+	MeshModRender_CacheMapping mapping;
+	if (!MeshModRender_CacheLookup(cache, Key(id), mapping)) {
+		return false;
+	}
+	bool valid = mapping.vertexCount == VertexCount &&
+			mapping.boundsMin.y == -2.0f &&
+			mapping.boundsMax.z == (float) id;
+	for (uint32_t i = 0; i < VertexCount * VertexSize; ++i) {
+		valid = valid && ((uint8_t const*) mapping.vertices)[i] == (uint8_t) id;
+	}
+	MeshModRender_CacheReleaseMapping(mapping);
+	return valid;
+}
+
+} // end anonymous namespace
+
+TEST_CASE("Cache entries round trip", "[MeshModRender Cache]") {
+	ClearDirectory();
+	MeshModRender_Cache* cache = MeshModRender_CacheCreate(CacheDirectory, 1024 * 1024);
+	REQUIRE(cache);
+
+	CHECK_FALSE(Has(cache, 1));
+	REQUIRE(Put(cache, 1));
+	REQUIRE(Put(cache, 2));
+	CHECK(Has(cache, 1));
+	CHECK(Has(cache, 2));
+	CHECK_FALSE(Has(cache, 3));
+	// any part of the key differing misses
+	MeshModRender_CacheMapping mapping;
+	MeshModRender_CacheKey otherStyle = Key(1);
+	otherStyle.style = 1;
+	CHECK_FALSE(MeshModRender_CacheLookup(cache, otherStyle, mapping));
+
+	// a file shorter than its vertex count is never mapped
+	MeshModRender_CacheWriter writer;
+	uint32_t const truncated = 0;
+	REQUIRE(MeshModRender_CacheBeginWrite(cache, Key(3), VertexCount, writer));
+	MeshModRender_CacheWrite(writer, &truncated, sizeof(truncated));
+	MeshModRender_CacheEndWrite(cache, writer, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
+	CHECK_FALSE(Has(cache, 3));
+	MeshModRender_CacheDestroy(cache);
+
+	// and they are still there next run
+	cache = MeshModRender_CacheCreate(CacheDirectory, 1024 * 1024);
+	REQUIRE(cache);
+	CHECK(Has(cache, 1));
+	CHECK(Has(cache, 2));
+	MeshModRender_CacheDestroy(cache);
+}
+
+TEST_CASE("Cache replays its journal after an unclean exit", "[MeshModRender Cache]") {
+	ClearDirectory();
+	MeshModRender_Cache* crashed = MeshModRender_CacheCreate(CacheDirectory, 1024 * 1024);
+	REQUIRE(crashed);
+	REQUIRE(Put(crashed, 1));
+	REQUIRE(Put(crashed, 2));
+
+	// the first is never destroyed before this one opens, so the index has
+	// neither entry and only the journal knows about them
+	MeshModRender_Cache* cache = MeshModRender_CacheCreate(CacheDirectory, 1024 * 1024);
+	REQUIRE(cache);
+	CHECK(Has(cache, 1));
+	CHECK(Has(cache, 2));
+	CHECK_FALSE(Has(cache, 3));
+	MeshModRender_CacheDestroy(cache);
+	MeshModRender_CacheDestroy(crashed);
+}
+
+TEST_CASE("Cache evicts the least recently used entries", "[MeshModRender Cache]") {
+	ClearDirectory();
+	MeshModRender_Cache* cache = MeshModRender_CacheCreate(CacheDirectory, EntryBytes * 3);
+	REQUIRE(cache);
+	REQUIRE(Put(cache, 1));
+	REQUIRE(Put(cache, 2));
+	REQUIRE(Put(cache, 3));
+	// 2 is now the oldest use
+	CHECK(Has(cache, 1));
+	CHECK(Has(cache, 3));
+
+	REQUIRE(Put(cache, 4));
+	CHECK(Has(cache, 1));
+	CHECK_FALSE(Has(cache, 2));
+	CHECK(Has(cache, 3));
+	CHECK(Has(cache, 4));
+
+	REQUIRE(Put(cache, 5));
+	CHECK_FALSE(Has(cache, 1));
+	CHECK(Has(cache, 5));
+	MeshModRender_CacheDestroy(cache);
+
+	// a smaller cap next run evicts down to it
+	cache = MeshModRender_CacheCreate(CacheDirectory, EntryBytes);
+	REQUIRE(cache);
+	CHECK(Has(cache, 5));
+	CHECK_FALSE(Has(cache, 3));
+	CHECK_FALSE(Has(cache, 4));
+	MeshModRender_CacheDestroy(cache);
+}
@@ -0,0 +1,83 @@
+#include "al2o3_catch2/catch2.hpp"
+#include "al2o3_memory/memory.h"
+#include "al2o3_cadt/vector.h"
+
+#include "../src/manager.hpp"
+
+namespace {
+
+uint32_t const ThreadCount = 4;
+uint32_t const CommandsPerThread = 2000;
+
+struct Recorder {
+	MeshModRender_Manager* manager;
+	uint32_t thread;
+	Thread_Atomic32_t* finished;
+};
+
+// the handle carries the thread in the top bits and its own count in the rest
+void RecordCommands(void* data) {
+	auto recorder = (Recorder*) data;
+	for(uint32_t i = 0; i < CommandsPerThread; ++i) {
+		MeshModRender_Command command = {};
+		command.type = MMR_CMD_SET_STYLE;
+		command.handle = (recorder->thread << 16) | i;
+		command.style = MMR_RS_NORMAL;
+		MeshModRender_CommandPush(recorder->manager, command);
+	}
+	Thread_AtomicFetchAdd32Relaxed(recorder->finished, 1);
+}
+
+} // end anonymous namespace
+
+TEST_CASE("Commands from every shard drain in the order they were numbered", "[MeshModRender Commands]") {
+	auto manager = (MeshModRender_Manager*) MEMORY_CALLOC(1, sizeof(MeshModRender_Manager));
+	REQUIRE(manager);
+	manager->concurrent = true;
+	REQUIRE(MeshModRender_CommandQueuesCreate(manager));
+	// start near the top so the sequence wraps part way through
+	uint32_t const firstSequence = 0xFFFFFFFFu - (ThreadCount * CommandsPerThread) / 2;
+	Thread_AtomicStore32Relaxed(&manager->commandSequence, firstSequence);
+
+	Thread_Atomic32_t finished = {};
+	Recorder recorders[ThreadCount];
+	Thread_Thread threads[ThreadCount];
+	for(uint32_t i = 0; i < ThreadCount; ++i) {
+		recorders[i] = { manager, i, &finished };
+		REQUIRE(Thread_ThreadCreate(&threads[i], &RecordCommands, &recorders[i]));
+	}
+
+	// collect while the threads are still pushing, then once more after
+	uint32_t nextSequence = firstSequence;
+	uint32_t nextPerThread[ThreadCount] = {};
+	uint32_t total = 0;
+	bool ordered = true;
+	bool done = false;
+	while(!done) {
+		done = Thread_AtomicLoad32Relaxed(&finished) == ThreadCount;
+		uint32_t const count = MeshModRender_CommandCollect(manager);
+		for(uint32_t i = 0; i < count; ++i) {
+			auto command = (MeshModRender_Command const*) CADT_VectorAt(manager->drainCommands, i);
+			// every shard is taken at once, so nothing numbered is ever left behind
+			ordered = ordered && command->sequence == nextSequence;
+			nextSequence = command->sequence + 1;
+
+			uint32_t const thread = command->handle >> 16;
+			REQUIRE(thread < ThreadCount);
+			ordered = ordered && (command->handle & 0xFFFF) == nextPerThread[thread];
+			nextPerThread[thread] = (command->handle & 0xFFFF) + 1;
+		}
+		total += count;
+	}
+	CHECK(ordered);
+	CHECK(total == ThreadCount * CommandsPerThread);
+	for(uint32_t i = 0; i < ThreadCount; ++i) {
+		CHECK(nextPerThread[i] == CommandsPerThread);
+		Thread_ThreadJoin(&threads[i]);
+		Thread_ThreadDestroy(&threads[i]);
+	}
+
+	MeshModRender_ReleaseAll(manager);
+	MeshModRender_CommandQueuesDestroy(manager);
+	MEMORY_FREE(manager);
+}
@@ -0,0 +1,70 @@
+#include "al2o3_catch2/catch2.hpp"
+#include "al2o3_memory/memory.h"
+
+#include "../src/allocators.hpp"
+#include "../src/occlusionbuffer.hpp"
+
+namespace {
+
+Math_Mat4F Translation(float x, float y, float z) {
+	// row major like the local matrices the occlusion buffer is given
+	Math_Mat4F m = {};
+	m.v[0] = m.v[5] = m.v[10] = m.v[15] = 1.0f;
+	m.v[3] = x;
+	m.v[7] = y;
+	m.v[11] = z;
+	return m;
+}
+
+// left handed 90 degree fov looking down +z, column major as uploaded
+Math_Mat4F Perspective(float nearZ, float farZ, bool reversed) {
+	Math_Mat4F m = {};
+	m.v[0] = 1.0f;
+	m.v[5] = 1.0f;
+	m.v[10] = reversed ? nearZ / (nearZ - farZ) : farZ / (farZ - nearZ);
+	m.v[11] = 1.0f;
+	m.v[14] = reversed ? -farZ * nearZ / (nearZ - farZ) : -nearZ * farZ / (farZ - nearZ);
+	return m;
+}
+
+} // end anonymous namespace
+
+TEST_CASE("Occlusion buffer culls bounds behind a quad", "[MeshModRender OcclusionBuffer]") {
+	MeshModRender_Heap heap = { &Memory_GlobalAllocator, {} };
+	MeshModRender_OcclusionBuffer* buffer = MeshModRender_OcclusionBufferCreate(&heap, 256, 144);
+	REQUIRE(buffer);
+
+	// a 4x4 quad 5 units in front of the camera
+	float const quad[6][3] = {
+			{ -2.0f, -2.0f, 5.0f }, { 2.0f, -2.0f, 5.0f }, { 2.0f, 2.0f, 5.0f },
+			{ -2.0f, -2.0f, 5.0f }, { 2.0f, 2.0f, 5.0f }, { -2.0f, 2.0f, 5.0f },
+	};
+	Math_Vec3F const boundsMin = { -0.5f, -0.5f, -0.5f };
+	Math_Vec3F const boundsMax = { 0.5f, 0.5f, 0.5f };
+	Math_Vec3F const nearBoundsMin = { -0.01f, -0.01f, -0.01f };
+	Math_Vec3F const nearBoundsMax = { 0.01f, 0.01f, 0.01f };
+
+	for(int reversed = 0; reversed < 2; ++reversed) {
+		Math_Mat4F const projection = Perspective(0.1f, 100.0f, reversed != 0);
+		MeshModRender_OcclusionBufferBegin(buffer, projection, projection);
+		REQUIRE(MeshModRender_OcclusionBufferAddTriangles(buffer, Translation(0, 0, 0), quad, sizeof(quad[0]), 2));
+		MeshModRender_OcclusionBufferEnd(buffer, nullptr);
+
+		CHECK_FALSE(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, 10), boundsMin, boundsMax));
+		CHECK(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, 3), boundsMin, boundsMax));
+		CHECK(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, 5), boundsMin, boundsMax));
+		CHECK(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(5, 0, 10), boundsMin, boundsMax));
+		CHECK(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, 0), boundsMin, boundsMax));
+		CHECK_FALSE(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(50, 0, 10), boundsMin, boundsMax));
+		CHECK_FALSE(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, -10), boundsMin, boundsMax));
+		// in front of the eye but entirely closer than the near plane
+		CHECK_FALSE(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, 0.05f), nearBoundsMin, nearBoundsMax));
+
+		// stale contents never cull
+		MeshModRender_OcclusionBufferInvalidate(buffer);
+		CHECK(MeshModRender_OcclusionBufferTestBounds(buffer, Translation(0, 0, 10), boundsMin, boundsMax));
+	}
+
+	MeshModRender_OcclusionBufferDestroy(buffer);
+	CHECK(Thread_AtomicLoad64Relaxed(&heap.counters.liveBytes) == 0);
+}
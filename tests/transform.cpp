@@ -0,0 +1,112 @@
+#include "al2o3_catch2/catch2.hpp"
+
+#include "../src/manager.hpp"
+#include <math.h>
+
+namespace {
+
+// gauss jordan with partial pivoting in double, row major in and out
+bool ReferenceInverse(float const* m, double* out) {
+	double a[4][8];
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			a[r][c] = m[r * 4 + c];
+			a[r][c + 4] = r == c ? 1.0 : 0.0;
+		}
+	}
+	for (int c = 0; c < 4; ++c) {
+		int pivot = c;
+		for (int r = c + 1; r < 4; ++r) {
+			pivot = fabs(a[r][c]) > fabs(a[pivot][c]) ? r : pivot;
+		}
+		if (fabs(a[pivot][c]) < 1e-12) {
+			return false;
+		}
+		for (int k = 0; k < 8; ++k) {
+			double const tmp = a[c][k];
+			a[c][k] = a[pivot][k];
+			a[pivot][k] = tmp;
+		}
+		double const scale = 1.0 / a[c][c];
+		for (int k = 0; k < 8; ++k) {
+			a[c][k] *= scale;
+		}
+		for (int r = 0; r < 4; ++r) {
+			if (r == c) {
+				continue;
+			}
+			double const factor = a[r][c];
+			for (int k = 0; k < 8; ++k) {
+				a[r][k] -= factor * a[c][k];
+			}
+		}
+	}
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			out[r * 4 + c] = a[r][c + 4];
+		}
+	}
+	return true;
+}
+
+// row major like the local matrices given to the manager
+Math_Mat4F Matrix(float const (&rows)[16]) {
+	Math_Mat4F m;
+	memcpy(m.v, rows, sizeof(m.v));
+	return m;
+}
+
+bool MatchesReference(Math_Mat4F const& local, MeshModRender_LocalUniforms const& uniforms) {
+	double reference[16];
+	if (!ReferenceInverse(local.v, reference)) {
+		return false;
+	}
+	double largest = 0.0;
+	for (int i = 0; i < 16; ++i) {
+		largest = fabs(reference[i]) > largest ? fabs(reference[i]) : largest;
+	}
+	for (int i = 0; i < 16; ++i) {
+		if (fabs(uniforms.localToWorldTranspose.v[i] - reference[i]) > 1e-5 * largest) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // end anonymous namespace
+
+TEST_CASE("Local uniforms hold the transpose and the inverse", "[MeshModRender Transform]") {
+	float const angle = 0.7f;
+	float const c = cosf(angle) * 2.0f;
+	float const s = sinf(angle) * 2.0f;
+	Math_Mat4F const locals[] = {
+			// identity
+			Matrix({ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 }),
+			// rotation about y with a uniform scale of 2 and a translation
+			Matrix({ c, 0, s, 10, 0, 2, 0, -3, -s, 0, c, 4, 0, 0, 0, 1 }),
+			// non uniform scale and shear
+			Matrix({ 3, 0.5f, 0, 1, 0, 0.25f, 0, 2, 0.2f, 0, 5, -7, 0, 0, 0, 1 }),
+			// a tiny uniform scale is still rigid
+			Matrix({ 1e-3f, 0, 0, 0, 0, 1e-3f, 0, 0, 0, 0, 1e-3f, 0, 0, 0, 0, 1 }),
+			// projective
+			Matrix({ 1, 0, 0, 2, 0, 2, 0, 0, 0, 0.5f, 1, 1, 0.1f, 0.2f, 0, 1.5f }),
+	};
+	uint32_t const count = sizeof(locals) / sizeof(locals[0]);
+
+	MeshModRender_LocalUniforms uniforms[count];
+	MeshModRender_ComputeLocalUniforms(locals, nullptr, count, uniforms);
+	for (uint32_t i = 0; i < count; ++i) {
+		// uploaded column major
+		for (int r = 0; r < 4; ++r) {
+			for (int k = 0; k < 4; ++k) {
+				CHECK(uniforms[i].localToWorld.v[k * 4 + r] == locals[i].v[r * 4 + k]);
+			}
+		}
+		CHECK(MatchesReference(locals[i], uniforms[i]));
+	}
+
+	// a given inverse is used untouched
+	Math_Mat4F const inverse = Matrix({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 });
+	MeshModRender_ComputeLocalUniforms(locals, &inverse, 1, uniforms);
+	CHECK(memcmp(uniforms[0].localToWorldTranspose.v, inverse.v, sizeof(inverse.v)) == 0);
+}